@@ -0,0 +1,1171 @@
+// Headless benchmarks for chunk generation and meshing. Links only against
+// the GL-free core library so it runs on build machines without a display.
+#include "chunk.hpp"
+#include "chunk_generator.hpp"
+#include "chunk_io.hpp"
+#include "chunk_manager.hpp"
+#include "chunk_mesher.hpp"
+#include "flat_chunk_map.hpp"
+#include "frame_timing.hpp"
+#include "frustum.hpp"
+#include "job_system.hpp"
+#include "mesh_queue.hpp"
+#include "mesh_sink.hpp"
+#include "noise.hpp"
+#include "types.hpp"
+#include "visibility.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+using namespace lexov;
+using bench_clock = std::chrono::high_resolution_clock;
+using seconds = std::chrono::duration<double>;
+
+template <class Function> double time_it(const Function &f) {
+  const auto start = bench_clock::now();
+  f();
+  return seconds{ bench_clock::now() - start }.count();
+}
+
+void report(const std::string &name, const double value,
+            const std::string &unit) {
+  std::cout << name << ": " << value << " " << unit << std::endl;
+}
+
+// Chunks sampled from the middle layer of the default world
+std::vector<chunk_key> sample_keys(const int count) {
+  std::vector<chunk_key> keys;
+  for (int i = 0; i < count; ++i) {
+    keys.emplace_back((world_width / 4) + i % (world_width / 2),
+                      world_height / 2,
+                      (world_depth / 4) + (i / 2) % (world_depth / 2));
+  }
+  return keys;
+}
+
+const char *storage_name(const chunk_storage storage) {
+  switch (storage) {
+  case chunk_storage::palette:
+    return "palette";
+  case chunk_storage::octree:
+    return "octree";
+  case chunk_storage::array:
+  default:
+    return "array";
+  }
+}
+
+void bench_generators(const int iterations) {
+  const double voxels = static_cast<double>(chunk::volume) * iterations;
+  const std::vector<std::pair<std::string, std::function<chunk_ptr(int)>>>
+  generators{
+    { "make_solid_chunk",
+      [](int) { return chunk_generator::make_solid_chunk(block_type::stone); } },
+    { "make_random_chunk", [](int i) {
+      static const auto keys = sample_keys(64);
+      return chunk_generator::make_random_chunk(keys[i % keys.size()], 0.5);
+    } },
+    { "make_pyramid", [](int) { return chunk_generator::make_pyramid(); } },
+    { "make_floating_rock", [](int i) {
+      static const auto keys = sample_keys(64);
+      return std::get<1>(
+          chunk_generator::make_floating_rock(keys[i % keys.size()]));
+    } },
+  };
+  for (const auto &g : generators) {
+    const auto t = time_it([&]() {
+      for (int i = 0; i < iterations; ++i) {
+        g.second(i);
+      }
+    });
+    report("generate/" + g.first, voxels / t, "voxels/s");
+  }
+  // Writing the voxels of a generated chunk voxel by voxel against the bulk
+  // writes, which do the bookkeeping once per call
+  std::vector<block_type> dense(chunk::volume, block_type::air);
+  std::get<1>(chunk_generator::make_floating_rock(sample_keys(1)[0]))
+      ->get_voxels(dense.data(), chunk::width, chunk::width * chunk::height);
+  const auto at = [&dense](const int x, const int y, const int z) {
+    return dense[x + chunk::width * (y + chunk::height * z)];
+  };
+  for (const auto storage : { chunk_storage::array, chunk_storage::palette,
+                              chunk_storage::octree }) {
+    const auto name = std::string{ "generate/write/" } + storage_name(storage);
+    const auto set_time = time_it([&]() {
+      for (int i = 0; i < iterations; ++i) {
+        auto c = make_chunk(storage);
+        for (local_size_t z = 0; z < chunk::depth; ++z) {
+          for (local_size_t x = 0; x < chunk::width; ++x) {
+            for (local_size_t y = 0; y < chunk::height; ++y) {
+              c->set(x, y, z, at(x, y, z));
+            }
+          }
+        }
+      }
+    });
+    const auto column_time = time_it([&]() {
+      std::array<block_type, chunk::height> column;
+      for (int i = 0; i < iterations; ++i) {
+        auto c = make_chunk(storage);
+        for (local_size_t z = 0; z < chunk::depth; ++z) {
+          for (local_size_t x = 0; x < chunk::width; ++x) {
+            for (local_size_t y = 0; y < chunk::height; ++y) {
+              column[y] = at(x, y, z);
+            }
+            c->set_column(x, 0, z, chunk::height, column.data());
+          }
+        }
+      }
+    });
+    const auto voxels_time = time_it([&]() {
+      for (int i = 0; i < iterations; ++i) {
+        make_chunk(storage)->set_voxels(dense.data());
+      }
+    });
+    report(name + "/set", voxels / set_time, "voxels/s");
+    report(name + "/set_column", voxels / column_time, "voxels/s");
+    report(name + "/set_voxels", voxels / voxels_time, "voxels/s");
+  }
+  // Generation is a pure function of key and seed: a second run encodes to
+  // the same bytes, another seed does not
+  const auto keys = sample_keys(std::min(iterations, 8));
+  std::size_t reproduced = 0, reseeded = 0;
+  for (const auto &key : keys) {
+    const auto encode = [&key](const world_seed seed) {
+      return chunk_io::encode_chunk(*std::get<1>(
+          chunk_generator::make_floating_rock(key, chunk_storage::array,
+                                              seed)));
+    };
+    const auto first = encode(default_world_seed);
+    reproduced += encode(default_world_seed) == first;
+    reseeded += encode(default_world_seed + 1) != first;
+  }
+  report("generate/make_floating_rock/reproduced", reproduced,
+         "of " + std::to_string(keys.size()) + " chunks");
+  report("generate/make_floating_rock/reseeded", reseeded,
+         "of " + std::to_string(keys.size()) + " chunks differ");
+  // Sampling the density on a coarser lattice against every voxel
+  std::vector<chunk_ptr> exact;
+  const auto lattice_keys = sample_keys(iterations);
+  for (const auto &key : lattice_keys) {
+    exact.push_back(std::get<1>(chunk_generator::make_floating_rock(key)));
+  }
+  for (const local_size_t spacing : { 2, 4, 8 }) {
+    const auto name =
+        "generate/make_floating_rock/lattice_" + std::to_string(spacing);
+    std::vector<chunk_ptr> coarse;
+    const auto t = time_it([&]() {
+      for (const auto &key : lattice_keys) {
+        coarse.push_back(std::get<1>(chunk_generator::make_floating_rock(
+            key, chunk_storage::array, default_world_seed, spacing)));
+      }
+    });
+    std::size_t solid = 0, mismatches = 0;
+    for (std::size_t i = 0; i < exact.size(); ++i) {
+      for_each_voxel(*exact[i], [&](chunk &c, const local_size_t x,
+                                    const local_size_t y,
+                                    const local_size_t z) {
+        solid += c.is_solid(x, y, z);
+        mismatches += c.get(x, y, z) != coarse[i]->get(x, y, z);
+      });
+    }
+    report(name, voxels / t, "voxels/s");
+    report(name + "/mismatches", 100.0 * mismatches / solid,
+           "% of solid voxels");
+  }
+}
+
+void bench_noise(const int iterations) {
+  // sample points spanning the coordinates make_floating_rock feeds in
+  const std::size_t n = chunk::volume * iterations / 16;
+  std::vector<float> x(n), y(n), z(n), batch(n), scalar(n);
+  std::mt19937 e{ 1 };
+  std::uniform_real_distribution<float> dist(0.0f, 10.0f);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = dist(e);
+    y[i] = dist(e);
+    z[i] = dist(e);
+  }
+  for (const int octaves : { 1, 5 }) {
+    const auto name = "noise/octaves_" + std::to_string(octaves);
+    const auto scalar_time = time_it([&]() {
+      for (std::size_t i = 0; i < n; ++i) {
+        scalar[i] = noise::simplex_octaves(octaves, x[i], y[i], z[i]);
+      }
+    });
+    const auto batch_time = time_it([&]() {
+      noise::simplex_octaves_batch(octaves, x.data(), y.data(), z.data(),
+                                   batch.data(), n);
+    });
+    float max_error = 0.0f;
+    for (std::size_t i = 0; i < n; ++i) {
+      max_error = std::max(max_error, std::fabs(batch[i] - scalar[i]));
+    }
+    report(name + "/scalar", n / scalar_time, "points/s");
+    report(name + "/" + noise::instruction_set(), n / batch_time, "points/s");
+    report(name + "/max_error", max_error, "");
+    if (max_error > octaves * noise::batch_tolerance) {
+      std::cout << name << ": batch results exceed the tolerance!" << std::endl;
+    }
+  }
+}
+
+void bench_meshing(const int iterations) {
+  std::vector<chunk_ptr> chunks;
+  for (const auto &key : sample_keys(iterations)) {
+    chunks.push_back(std::get<1>(chunk_generator::make_floating_rock(key)));
+  }
+  std::size_t faces = 0;
+  for (const auto &c : chunks) {
+    buffer_data mesh_data;
+    chunk_mesher::build_mesh(mesh_data, *c, mesh_mode::naive);
+    faces += mesh_data.size() / vertices_per_quad;
+  }
+  for (const auto mode : { mesh_mode::naive, mesh_mode::greedy }) {
+    const auto name = mode == mesh_mode::naive ? "naive" : "greedy";
+    std::size_t vertices = 0;
+    const auto t = time_it([&]() {
+      for (const auto &c : chunks) {
+        buffer_data mesh_data;
+        chunk_mesher::build_mesh(mesh_data, *c, mode);
+        vertices += mesh_data.size();
+      }
+    });
+    report(std::string{ "mesh/" } + name, faces / t, "faces/s");
+    report(std::string{ "mesh/" } + name,
+           vertices / static_cast<double>(chunks.size()), "vertices/chunk");
+    // Indexed quads against two unindexed triangles per quad
+    const double quads = vertices / vertices_per_quad;
+    report(std::string{ "mesh/" } + name,
+           quads * vertices_per_quad * sizeof(voxel_vertex) / chunks.size(),
+           "bytes/chunk");
+    report(std::string{ "mesh/" } + name + "/unindexed",
+           quads * indices_per_quad * sizeof(voxel_vertex) / chunks.size(),
+           "bytes/chunk");
+  }
+  // A voxel edit remeshes the section holding it, not the whole chunk. The
+  // snapshot is taken either way.
+  const std::size_t edited_section = chunk::sections / 2;
+  double snapshot_time = 0.0;
+  double chunk_time = 0.0;
+  double section_time = 0.0;
+  std::size_t vertices = 0;
+  for (const auto &c : chunks) {
+    chunk_snapshot s;
+    snapshot_time += time_it([&]() { s.load(*c); });
+    chunk_time += time_it([&]() {
+      buffer_data mesh_data;
+      chunk_mesher::build_mesh(mesh_data, s, mesh_mode::greedy);
+      vertices += mesh_data.size();
+    });
+    section_time += time_it([&]() {
+      buffer_data mesh_data;
+      chunk_mesher::build_section_mesh(mesh_data, s, mesh_mode::greedy,
+                                       edited_section);
+      vertices += mesh_data.size();
+    });
+  }
+  const double edits = chunks.size();
+  report("mesh/edit/snapshot", snapshot_time / edits * 1e6, "us/edit");
+  report("mesh/edit/chunk", chunk_time / edits * 1e6, "us/edit");
+  report("mesh/edit/section", section_time / edits * 1e6, "us/edit");
+  if (vertices == 0) {
+    std::cout << "mesh/edit: no vertices" << std::endl;
+  }
+}
+
+void bench_storage(const int iterations) {
+  const auto keys = sample_keys(iterations);
+  for (const auto storage : { chunk_storage::array, chunk_storage::palette,
+                              chunk_storage::octree }) {
+    const auto name = std::string{ "storage/" } + storage_name(storage);
+    std::vector<chunk_ptr> chunks;
+    const auto generate_time = time_it([&]() {
+      for (const auto &key : keys) {
+        chunks.push_back(
+            std::get<1>(chunk_generator::make_floating_rock(key, storage)));
+      }
+    });
+    std::size_t bytes = 0;
+    for (const auto &c : chunks) {
+      bytes += c->memory_usage();
+    }
+    const auto mesh_time = time_it([&]() {
+      for (const auto &c : chunks) {
+        buffer_data mesh_data;
+        chunk_mesher::build_mesh(mesh_data, *c, mesh_mode::naive);
+      }
+    });
+    report(name + "/generate", chunk::volume * keys.size() / generate_time,
+           "voxels/s");
+    report(name + "/memory", bytes / static_cast<double>(chunks.size()),
+           "bytes/chunk");
+    report(name + "/mesh", chunks.size() / mesh_time, "chunks/s");
+  }
+  // uniform chunks are where the palette backend shines
+  const auto air = chunk_generator::make_solid_chunk(block_type::air,
+                                                     chunk_storage::palette);
+  const auto stone = chunk_generator::make_solid_chunk(block_type::stone,
+                                                       chunk_storage::palette);
+  report("storage/palette/uniform_air/memory", air->memory_usage(), "bytes");
+  report("storage/palette/uniform_stone/memory", stone->memory_usage(), "bytes");
+}
+
+// Chunk keys of a square area with world_height layers, in random order
+std::vector<chunk_key> area_keys(const std::size_t count) {
+  const auto layers = static_cast<std::size_t>(world_height);
+  const auto side = static_cast<world_size_t>(
+      std::ceil(std::sqrt(count / static_cast<double>(layers))));
+  std::vector<chunk_key> keys;
+  for (world_size_t z = 0; z < side && keys.size() < count; ++z) {
+    for (world_size_t x = 0; x < side && keys.size() < count; ++x) {
+      for (world_size_t y = 0; y < world_height && keys.size() < count; ++y) {
+        keys.emplace_back(x - side / 2, y, z - side / 2);
+      }
+    }
+  }
+  std::shuffle(keys.begin(), keys.end(), std::default_random_engine{ 42 });
+  return keys;
+}
+
+// The operations chunk_manager performs: insert, the 6 neighbor lookups of
+// insert_chunk, a full scan as in update, and erase
+template <class Map>
+void bench_chunk_map(const std::string &name,
+                     const std::vector<chunk_key> &keys) {
+  Map map;
+  const double n = keys.size();
+  const auto insert_time = time_it([&]() {
+    for (const auto &key : keys) {
+      map[key] = nullptr;
+    }
+  });
+  std::size_t found = 0;
+  const auto lookup_time = time_it([&]() {
+    for (const auto &key : keys) {
+      const auto x = std::get<0>(key);
+      const auto y = std::get<1>(key);
+      const auto z = std::get<2>(key);
+      found += map.find(chunk_key{ x, y, z - 1 }) != map.end();
+      found += map.find(chunk_key{ x, y, z + 1 }) != map.end();
+      found += map.find(chunk_key{ x - 1, y, z }) != map.end();
+      found += map.find(chunk_key{ x + 1, y, z }) != map.end();
+      found += map.find(chunk_key{ x, y + 1, z }) != map.end();
+      found += map.find(chunk_key{ x, y - 1, z }) != map.end();
+    }
+  });
+  std::size_t empty = 0;
+  const auto scan_time = time_it([&]() {
+    for (const auto &itr : map) {
+      empty += !itr.second;
+    }
+  });
+  const auto erase_time = time_it([&]() {
+    for (const auto &key : keys) {
+      map.erase(key);
+    }
+  });
+  // every key of the area has at least one neighbor
+  if (found < keys.size() || empty != keys.size() || !map.empty()) {
+    std::cerr << name << ": inconsistent map" << std::endl;
+  }
+  report(name + "/insert", insert_time / n * 1e9, "ns/op");
+  report(name + "/neighbor_lookup", lookup_time / (6 * n) * 1e9, "ns/op");
+  report(name + "/scan", scan_time / n * 1e9, "ns/entry");
+  report(name + "/erase", erase_time / n * 1e9, "ns/op");
+}
+
+// Counts its default constructions
+struct counted {
+  counted() { ++constructed; }
+  static std::size_t constructed;
+};
+std::size_t counted::constructed = 0;
+
+void bench_chunk_maps() {
+  using tree_map = std::map<chunk_key, chunk_ptr>;
+  using hash_map =
+      std::unordered_map<chunk_key, chunk_ptr, chunk_hash, chunk_hash_equal>;
+  for (const std::size_t count : { 10000, 50000, 100000 }) {
+    const auto keys = area_keys(count);
+    const auto name = "map/" + std::to_string(count);
+    bench_chunk_map<tree_map>(name + "/std::map", keys);
+    bench_chunk_map<hash_map>(name + "/std::unordered_map", keys);
+    bench_chunk_map<flat_chunk_map<chunk_ptr>>(name + "/flat_chunk_map", keys);
+  }
+  // operator[] on a present key must not build a value, the renderer's
+  // chunk_mesh values own GL objects
+  const auto keys = area_keys(1000);
+  flat_chunk_map<counted> map;
+  for (int pass = 0; pass < 4; ++pass) {
+    for (const auto &key : keys) {
+      map[key];
+    }
+  }
+  report("map/operator[]/constructed", counted::constructed,
+         "values for " + std::to_string(keys.size()) + " keys");
+}
+
+// Column major perspective projection times a view that looks along -z
+// rotated by yaw around y, like the camera's
+std::array<float, 16> view_projection(const std::array<float, 3> &eye,
+                                      const float yaw) {
+  const float fov = 60.0f * 3.14159265f / 180.0f, aspect = 16.0f / 9.0f;
+  const float near = 0.1f, far = 1000.0f;
+  const float f = 1.0f / std::tan(fov / 2);
+  std::array<float, 16> p{};
+  p[0] = f / aspect;
+  p[5] = f;
+  p[10] = (far + near) / (near - far);
+  p[11] = -1.0f;
+  p[14] = 2 * far * near / (near - far);
+  // view: rotate by -yaw around y, then translate by -eye
+  const float c = std::cos(yaw), s = std::sin(yaw);
+  std::array<float, 16> v{};
+  v[0] = c;
+  v[2] = s;
+  v[5] = 1.0f;
+  v[8] = -s;
+  v[10] = c;
+  v[12] = -(c * eye[0] - s * eye[2]);
+  v[13] = -eye[1];
+  v[14] = -(s * eye[0] + c * eye[2]);
+  v[15] = 1.0f;
+  std::array<float, 16> m{};
+  for (int col = 0; col < 4; ++col) {
+    for (int row = 0; row < 4; ++row) {
+      for (int k = 0; k < 4; ++k) {
+        m[col * 4 + row] += p[k * 4 + row] * v[col * 4 + k];
+      }
+    }
+  }
+  return m;
+}
+
+void bench_culling(const int iterations) {
+  // Chunks within the default load radius around the camera
+  const int radius = 16, vertical = 3;
+  box_batch boxes;
+  boxes.half_extent = { { static_cast<float>(half_chunk_width),
+                          static_cast<float>(half_chunk_height),
+                          static_cast<float>(half_chunk_depth) } };
+  for (int z = -radius; z <= radius; ++z) {
+    for (int y = -vertical; y <= vertical; ++y) {
+      for (int x = -radius; x <= radius; ++x) {
+        boxes.push_back(x * chunk_width + half_chunk_width,
+                        y * chunk_height + half_chunk_height,
+                        z * chunk_depth + half_chunk_depth);
+      }
+    }
+  }
+  const std::array<float, 3> eye{ { 8.0f, 64.0f, 8.0f } };
+  std::vector<std::array<float, 16>> cameras;
+  for (int i = 0; i < iterations; ++i) {
+    cameras.push_back(view_projection(eye, 6.2831853f * i / iterations));
+  }
+  // The center point test render used before the frustum planes
+  std::size_t center_visible = 0;
+  for (const auto &m : cameras) {
+    for (std::size_t i = 0; i < boxes.size(); ++i) {
+      const float p[4] = { boxes.center_x[i], boxes.center_y[i],
+                           boxes.center_z[i], 1.0f };
+      float clip[4] = {};
+      for (int row = 0; row < 4; ++row) {
+        for (int k = 0; k < 4; ++k) {
+          clip[row] += m[k * 4 + row] * p[k];
+        }
+      }
+      const auto diameter_clip =
+          static_cast<float>(chunk_diameter) / std::abs(clip[3]);
+      center_visible += !(clip[2] < -chunk_diameter ||
+                          std::fabs(clip[0]) > 3 + diameter_clip ||
+                          std::fabs(clip[1]) > 3 + diameter_clip);
+    }
+  }
+  std::size_t scalar_visible = 0;
+  const auto scalar_time = time_it([&]() {
+    for (const auto &m : cameras) {
+      const frustum f{ m.data() };
+      for (std::size_t i = 0; i < boxes.size(); ++i) {
+        scalar_visible += f.intersects(
+            { { boxes.center_x[i], boxes.center_y[i], boxes.center_z[i] } },
+            boxes.half_extent);
+      }
+    }
+  });
+  std::size_t batch_visible = 0;
+  std::vector<std::uint32_t> draw_list;
+  const auto batch_time = time_it([&]() {
+    for (const auto &m : cameras) {
+      build_draw_list(frustum{ m.data() }, boxes, draw_list);
+      batch_visible += draw_list.size();
+    }
+  });
+  if (scalar_visible != batch_visible) {
+    std::cout << "cull: batch and scalar results differ!" << std::endl;
+  }
+  const double frames = cameras.size();
+  report("cull/chunks", boxes.size(), "chunks");
+  report("cull/center_test", center_visible / frames, "chunks drawn/frame");
+  report("cull/planes", batch_visible / frames, "chunks drawn/frame");
+  report("cull/scalar", scalar_time / frames * 1e6, "us/frame");
+  report(std::string{ "cull/" } + culling_instruction_set(),
+         batch_time / frames * 1e6, "us/frame");
+}
+
+// Takes every chunk and builds no meshes
+class null_sink : public mesh_sink {
+public:
+  bool on_chunk_update(const chunk_key &, const chunk &, const section_mask,
+                       const unsigned = 0) override {
+    return true;
+  }
+  bool on_chunk_insertion(const chunk_key &, const chunk &,
+                          const unsigned = 0) override {
+    return true;
+  }
+  void on_chunk_removal(const chunk_key &) override {}
+};
+
+// Cold start: generate and save; warm start: load from the region files
+void bench_regions(const int iterations) {
+  char directory[] = "/tmp/lexov_bench_XXXXXX";
+  if (!mkdtemp(directory)) {
+    std::cerr << "region: can't create a temporary directory" << std::endl;
+    return;
+  }
+  // sample_keys repeats keys, a save would overwrite an earlier one
+  auto keys = sample_keys(iterations);
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  // on the lattice the stores below default to, as the game streams them
+  std::vector<chunk_ptr> generated;
+  const auto generate_time = time_it([&]() {
+    for (const auto &key : keys) {
+      generated.push_back(std::get<1>(chunk_generator::make_floating_rock(
+          key, chunk_storage::palette, default_world_seed,
+          default_density_lattice)));
+    }
+  });
+  std::size_t disk_usage = 0;
+  const auto save_time = time_it([&]() {
+    region_store store{ directory };
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+      store.save(keys[i], chunk_io::encode_chunk(*generated[i]));
+    }
+    disk_usage = store.disk_usage();
+  });
+  std::vector<chunk_ptr> loaded;
+  const auto load_time = time_it([&]() {
+    region_store store{ directory };
+    for (const auto &key : keys) {
+      loaded.push_back(store.load(key, chunk_storage::palette));
+    }
+  });
+  std::size_t mismatches = 0;
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    if (!loaded[i]) {
+      ++mismatches;
+      continue;
+    }
+    for_each_voxel(*loaded[i], [&](chunk &c, const local_size_t x,
+                                   const local_size_t y, const local_size_t z) {
+      mismatches += c.get(x, y, z) != generated[i]->get(x, y, z);
+    });
+  }
+  // the files must not be read back by a world of another seed or density
+  // lattice, and closing the regions far from a camera keeps none of them
+  // open
+  std::size_t foreign_loads = 0, open_regions = 0;
+  {
+    region_store seeded{ directory, default_world_seed + 1 };
+    region_store sampled{ directory, default_world_seed, exact_density };
+    for (const auto &key : keys) {
+      for (auto store : { &seeded, &sampled }) {
+        try {
+          foreign_loads += store->load(key, chunk_storage::palette) != nullptr;
+        }
+        catch (std::runtime_error &) {
+        }
+      }
+    }
+    region_store reopened{ directory };
+    for (const auto &key : keys) {
+      reopened.load(key, chunk_storage::palette);
+    }
+    reopened.close_distant_regions(chunk_key{ 1 << 20, 0, 1 << 20 }, 8, 2);
+    open_regions = reopened.number_of_regions();
+  }
+  // a manager keeps the seed of its store, reseeding it would save the
+  // chunks of another world into the files
+  std::size_t reseeds_rejected = 0;
+  {
+    region_store store{ directory };
+    job_system jobs;
+    null_sink sink;
+    chunk_manager manager{ sink, jobs };
+    manager.set_region_store(&store);
+    manager.set_world_seed(store.get_seed());
+    try {
+      manager.set_world_seed(store.get_seed() + 1);
+    }
+    catch (std::runtime_error &) {
+      ++reseeds_rejected;
+    }
+    manager.set_region_store(nullptr);
+    manager.set_world_seed(store.get_seed() + 1);
+  }
+  // records that grow and shrink back again reuse the sectors they left
+  // behind instead of growing the files
+  std::size_t rewritten_usage = 0;
+  {
+    region_store store{ directory };
+    for (int round = 0; round < 4; ++round) {
+      for (const auto &key : keys) {
+        store.save(key, chunk_io::encode_chunk(
+                            *chunk_generator::make_random_chunk(key, 0.5)));
+      }
+      for (std::size_t i = 0; i < keys.size(); ++i) {
+        store.save(keys[i], chunk_io::encode_chunk(*generated[i]));
+      }
+    }
+    rewritten_usage = store.disk_usage();
+  }
+  std::size_t record_bytes = 0;
+  for (const auto &c : generated) {
+    record_bytes += chunk_io::encode_chunk(*c).size();
+  }
+  const double n = keys.size();
+  report("region/generate", generate_time / n * 1e6, "us/chunk");
+  report("region/save", save_time / n * 1e6, "us/chunk");
+  report("region/load", load_time / n * 1e6, "us/chunk");
+  report("region/record", record_bytes / n, "bytes/chunk");
+  report("region/file", disk_usage / n, "bytes/chunk");
+  report("region/file_after_rewrites", rewritten_usage / n, "bytes/chunk");
+  report("region/mismatches", mismatches, "voxels");
+  report("region/foreign_loads", foreign_loads, "chunks");
+  report("region/open_after_close", open_regions, "regions");
+  report("region/reseeds_rejected", reseeds_rejected, "of 1");
+  for (const auto &key : keys) {
+    const auto path = std::string{ directory } + "/r." +
+                      std::to_string(floor_div(std::get<0>(key), region_size)) +
+                      "." + std::to_string(std::get<1>(key)) + "." +
+                      std::to_string(floor_div(std::get<2>(key), region_size)) +
+                      ".lxr";
+    std::remove(path.c_str());
+  }
+  rmdir(directory);
+}
+
+using world_map = flat_chunk_map<chunk_ptr>;
+
+// mirrors the neighbor wiring done by chunk_manager::insert_chunk
+template <face side, face opposite>
+void link_neighbor(world_map &world, const chunk_ptr &c,
+                   const chunk_key &neighbor_key) {
+  const auto itr = world.find(neighbor_key);
+  if (itr != world.end()) {
+    itr->second->set_neighbor<opposite>(c);
+    c->set_neighbor<side>(itr->second);
+  }
+}
+
+void report_workers(const std::string &name, const job_system &jobs) {
+  const auto statistics = jobs.get_statistics();
+  for (std::size_t i = 0; i < statistics.size(); ++i) {
+    const auto &w = statistics[i];
+    std::cout << name << "/worker_" << i << ": " << w.jobs_executed
+              << " jobs, " << w.jobs_stolen << " stolen, "
+              << w.utilization * 100.0 << " % busy" << std::endl;
+  }
+}
+
+// Cost of a LEXOV_TIME_PHASE scope and of summarizing the histograms, which
+// the game does on every periodic dump
+void bench_timing(const int iterations) {
+  frame_timing timings;
+  const auto n = iterations * 16384;
+  const auto record_time = time_it([&]() {
+    for (int i = 0; i < n; ++i) {
+      const auto start = frame_timing::clock::now();
+      timings.record(frame_phase::update, frame_timing::clock::now() - start);
+    }
+  });
+  report("timing/scope", record_time / n * 1e9, "ns");
+  // a known distribution: the last history samples are 1 to history us
+  const auto history = phase_histogram::history;
+  for (std::size_t i = 1; i <= 2 * history; ++i) {
+    timings.record(frame_phase::draw,
+                   std::chrono::microseconds{ (i - 1) % history + 1 });
+  }
+  const auto s = timings.summarize(frame_phase::draw);
+  report("timing/draw/p50", s.p50, "ms");
+  report("timing/draw/p99", s.p99, "ms");
+  report("timing/draw/max", s.max, "ms");
+  std::ostringstream csv, json;
+  const auto dump_time = time_it([&]() {
+    timings.write_csv(csv);
+    timings.write_json(json);
+  });
+  report("timing/dump", dump_time * 1e6, "us");
+}
+
+// Streams chunks through a window the way the chunk_manager does: every
+// step generates and meshes one chunk and drops the oldest. Once the window
+// is full the chunk pool and the mesh buffers only recycle memory.
+void bench_allocations(const int iterations) {
+  job_system jobs;
+  const std::size_t window = 64;
+  // A walk over the middle layer, taken twice like a player going back and
+  // forth. The first walk warms up the pool and the mesh buffers.
+  const std::size_t steps = iterations * 4;
+  std::vector<chunk_key> keys;
+  for (std::size_t i = 0; i < 2 * steps; ++i) {
+    const auto j = (i % steps) % (world_width * world_depth);
+    keys.emplace_back(j % world_width, world_height / 2, j / world_width);
+  }
+  std::deque<std::tuple<chunk_key, chunk_ptr>> chunks;
+  mesh_queue queue{ jobs };
+  std::size_t drained = 0;
+  const auto drain = [&]() {
+    drained += queue.drain(window, [](const chunk_key &, std::size_t,
+                                      const buffer_data &,
+                                      const chunk_connectivity &) {});
+  };
+  const auto step = [&](const chunk_key &key) {
+    chunks.emplace_back(chunk_generator::make_floating_rock(key));
+    while (!queue.request(key, *std::get<1>(chunks.back()))) {
+      drain();
+      std::this_thread::yield();
+    }
+    if (chunks.size() > window) {
+      queue.cancel(std::get<0>(chunks.front()));
+      chunks.pop_front();
+    }
+  };
+  const auto finish = [&]() {
+    while (queue.size() > 0) {
+      drain();
+      std::this_thread::yield();
+    }
+  };
+  for (std::size_t i = 0; i < steps; ++i) {
+    step(keys[i]);
+  }
+  finish();
+  const auto pool_before = chunk_pool().get_statistics();
+  const auto buffers_before = queue.get_buffer_allocations();
+  drained = 0;
+  const auto t = time_it([&]() {
+    for (std::size_t i = steps; i < keys.size(); ++i) {
+      step(keys[i]);
+    }
+    finish();
+  });
+  const auto pool_after = chunk_pool().get_statistics();
+  report("alloc/stream", steps / t, "chunks/s");
+  report("alloc/stream/chunk_heap_allocations",
+         pool_after.heap_allocations - pool_before.heap_allocations,
+         "in " + std::to_string(steps) + " chunks");
+  report("alloc/stream/chunk_reuses", pool_after.reuses - pool_before.reuses,
+         "blocks");
+  report("alloc/stream/mesh_buffer_allocations",
+         queue.get_buffer_allocations() - buffers_before,
+         "in " + std::to_string(drained) + " section meshes");
+  report("alloc/pool/live", pool_after.live_blocks, "blocks");
+  report("alloc/pool/free", pool_after.free_blocks, "blocks");
+
+  // A chunk from the pool against one from the heap
+  const auto n = iterations * 64;
+  std::size_t solid = 0;
+  const auto heap_time = time_it([&]() {
+    for (int i = 0; i < n; ++i) {
+      chunk_ptr c = std::make_shared<dense_chunk>();
+      c->set(i % chunk::width, 0, 0, block_type::stone);
+      solid += c->count_solid_blocks();
+    }
+  });
+  const auto pool_time = time_it([&]() {
+    for (int i = 0; i < n; ++i) {
+      const auto c = make_chunk(chunk_storage::array);
+      c->set(i % chunk::width, 0, 0, block_type::stone);
+      solid += c->count_solid_blocks();
+    }
+  });
+  if (solid != 2 * static_cast<std::size_t>(n)) {
+    std::cerr << "alloc: chunks are not empty when handed out" << std::endl;
+  }
+  report("alloc/chunk/heap", n / heap_time, "chunks/s");
+  report("alloc/chunk/pool", n / pool_time, "chunks/s");
+}
+
+// Cave culling on the generated world: cameras at the center of every
+// chunk layer and above the world, looking around
+void bench_occlusion(const world_map &world) {
+  flat_chunk_map<chunk_connectivity> graph;
+  const auto connectivity_time = time_it([&]() {
+    chunk_snapshot s;
+    for (const auto &itr : world) {
+      s.load(*itr.second);
+      graph[itr.first] = visibility::compute_connectivity(s);
+    }
+  });
+  report("world/occlusion/connectivity",
+         connectivity_time / world.size() * 1e6, "us/chunk");
+  const chunk_key lo{ 0, 0, 0 };
+  const chunk_key hi{ world_width - 1, world_height - 1, world_depth - 1 };
+  const auto lookup = [&graph](const chunk_key &k) {
+    const auto itr = graph.find(k);
+    return itr == graph.end() ? nullptr : &itr->second;
+  };
+  box_batch boxes;
+  boxes.half_extent = { { static_cast<float>(half_chunk_width),
+                          static_cast<float>(half_chunk_height),
+                          static_cast<float>(half_chunk_depth) } };
+  std::vector<chunk_key> reachable;
+  std::vector<std::uint32_t> draw_list;
+  std::size_t frames = 0, frustum_drawn = 0, occlusion_drawn = 0;
+  std::size_t reached = 0;
+  double search_time = 0.0;
+  const auto add_box = [&boxes](const chunk_key &k) {
+    boxes.push_back(std::get<0>(k) * chunk_width + half_chunk_width,
+                    std::get<1>(k) * chunk_height + half_chunk_height,
+                    std::get<2>(k) * chunk_depth + half_chunk_depth);
+  };
+  for (world_size_t layer = 0; layer <= world_height; ++layer) {
+    const chunk_key camera{ world_width / 2, layer, world_depth / 2 };
+    search_time += time_it([&]() {
+      visibility::find_reachable_chunks(camera, lo, hi, lookup, reachable);
+    });
+    reached += reachable.size();
+    const std::array<float, 3> eye{
+      { static_cast<float>(std::get<0>(camera) * chunk_width + 8),
+        static_cast<float>(std::get<1>(camera) * chunk_height + 64),
+        static_cast<float>(std::get<2>(camera) * chunk_depth + 8) }
+    };
+    for (int yaw = 0; yaw < 8; ++yaw) {
+      const auto m = view_projection(eye, 6.2831853f * yaw / 8);
+      const frustum f{ m.data() };
+      boxes.clear();
+      for (const auto &itr : world) {
+        if (!itr.second->is_empty()) {
+          add_box(itr.first);
+        }
+      }
+      build_draw_list(f, boxes, draw_list);
+      frustum_drawn += draw_list.size();
+      boxes.clear();
+      for (const auto &k : reachable) {
+        if (!world.find(k)->second->is_empty()) {
+          add_box(k);
+        }
+      }
+      build_draw_list(f, boxes, draw_list);
+      occlusion_drawn += draw_list.size();
+      ++frames;
+    }
+  }
+  const double cameras = world_height + 1;
+  report("world/occlusion/search", search_time / cameras * 1e6, "us/frame");
+  report("world/occlusion/reachable", reached / cameras, "chunks");
+  report("world/occlusion/frustum", frustum_drawn / double(frames),
+         "chunks drawn/frame");
+  report("world/occlusion/frustum_and_caves",
+         occlusion_drawn / double(frames), "chunks drawn/frame");
+}
+
+// Memory, snapshot and greedy meshing time of the generated world copied
+// into every storage backend
+void bench_world_storage(const world_map &world) {
+  for (const auto storage : { chunk_storage::array, chunk_storage::palette,
+                              chunk_storage::octree }) {
+    const auto name = std::string{ "world/storage/" } + storage_name(storage);
+    world_map copy;
+    for (const auto &itr : world) {
+      auto c = make_chunk(storage);
+      for_each_voxel(*itr.second, [&c](chunk &source, const local_size_t x,
+                                       const local_size_t y,
+                                       const local_size_t z) {
+        c->set(x, y, z, source.get(x, y, z));
+      });
+      c->shrink_to_fit();
+      copy[itr.first] = c;
+    }
+    for (const auto &itr : copy) {
+      const auto x = std::get<0>(itr.first);
+      const auto y = std::get<1>(itr.first);
+      const auto z = std::get<2>(itr.first);
+      link_neighbor<face::back, face::front>(copy, itr.second,
+                                             chunk_key{ x, y, z + 1 });
+      link_neighbor<face::right, face::left>(copy, itr.second,
+                                             chunk_key{ x + 1, y, z });
+      link_neighbor<face::top, face::bottom>(copy, itr.second,
+                                             chunk_key{ x, y + 1, z });
+    }
+    std::size_t bytes = 0, vertices = 0;
+    for (const auto &itr : copy) {
+      bytes += itr.second->memory_usage();
+    }
+    chunk_snapshot s;
+    double snapshot_time = 0.0, mesh_time = 0.0;
+    buffer_data mesh_data;
+    for (const auto &itr : copy) {
+      const auto visible = chunk_mesher::visible_sections(*itr.second);
+      if (visible == 0) {
+        continue;
+      }
+      snapshot_time += time_it([&]() { s.load(*itr.second); });
+      mesh_time += time_it([&]() {
+        for (std::size_t section = 0; section < chunk::sections; ++section) {
+          if (visible & chunk::section_bit(section)) {
+            mesh_data.clear();
+            chunk_mesher::build_section_mesh(mesh_data, s, mesh_mode::greedy,
+                                             section);
+            vertices += mesh_data.size();
+          }
+        }
+      });
+    }
+    report(name + "/memory", bytes / static_cast<double>(copy.size()),
+           "bytes/chunk");
+    report(name + "/snapshot", snapshot_time / copy.size() * 1e6, "us/chunk");
+    report(name + "/mesh", mesh_time / copy.size() * 1e6, "us/chunk");
+    report(name + "/vertices", vertices, "vertices");
+  }
+}
+
+// Greedy vertices of the whole world at every level of detail, and with
+// the level picked by distance from a camera in the middle of the world the
+// way chunk_manager does with the default streaming_settings
+void bench_lod(const world_map &world) {
+  const streaming_settings settings;
+  const chunk_key camera{ world_width / 2, world_height / 2, world_depth / 2 };
+  const auto distance_level = [&](const chunk_key &k) {
+    const auto dx = std::get<0>(k) - std::get<0>(camera);
+    const auto dz = std::get<2>(k) - std::get<2>(camera);
+    unsigned level = 0;
+    for (const auto r : settings.lod_radius) {
+      level += dx * dx + dz * dz > r * r;
+    }
+    return level;
+  };
+  std::array<std::size_t, max_lod_level + 1> vertices{}, chunks{};
+  // Per distance level: vertices of its chunks at level 0 and at the level
+  std::array<std::size_t, max_lod_level + 1> full_detail{}, reduced{};
+  chunk_snapshot s;
+  buffer_data mesh_data;
+  for (unsigned level = 0; level <= max_lod_level; ++level) {
+    const auto mesh_time = time_it([&]() {
+      for (const auto &itr : world) {
+        const auto visible = chunk_mesher::visible_sections(*itr.second);
+        if (visible == 0) {
+          continue;
+        }
+        s.load(*itr.second);
+        mesh_data.clear();
+        for (std::size_t section = 0; section < chunk::sections; ++section) {
+          if (visible & chunk::section_bit(section)) {
+            chunk_mesher::build_section_mesh(mesh_data, s, mesh_mode::greedy,
+                                             section, level);
+          }
+        }
+        vertices[level] += mesh_data.size();
+        const auto wanted = distance_level(itr.first);
+        if (level == 0) {
+          full_detail[wanted] += mesh_data.size();
+        }
+        if (wanted == level) {
+          reduced[wanted] += mesh_data.size();
+        }
+      }
+    });
+    const auto name = "world/lod/level_" + std::to_string(level);
+    report(name + "/mesh", mesh_time / world.size() * 1e6, "us/chunk");
+    report(name + "/vertices", vertices[level], "vertices");
+  }
+  for (const auto &itr : world) {
+    ++chunks[distance_level(itr.first)];
+  }
+  std::size_t total = 0;
+  for (unsigned level = 0; level <= max_lod_level; ++level) {
+    const auto name = "world/lod/by_distance/level_" + std::to_string(level);
+    report(name + "/chunks", chunks[level], "chunks");
+    report(name + "/reduction",
+           full_detail[level] / std::max<double>(reduced[level], 1), "x");
+    total += reduced[level];
+  }
+  report("world/lod/by_distance/vertices", total, "vertices");
+  report("world/lod/by_distance/reduction",
+         vertices[0] / std::max<double>(total, 1), "x");
+}
+
+void bench_world() {
+  job_system jobs;
+  world_map world;
+  const auto generate_time = time_it([&]() {
+    std::vector<std::future<std::tuple<chunk_key, chunk_ptr>>> futures;
+    for (world_size_t z = 0; z < world_depth; ++z) {
+      for (world_size_t y = 0; y < world_height; ++y) {
+        for (world_size_t x = 0; x < world_width; ++x) {
+          const auto key = chunk_key{ x, y, z };
+          futures.push_back(jobs.submit(
+              [key]() { return chunk_generator::make_floating_rock(key); }));
+        }
+      }
+    }
+    for (auto &f : futures) {
+      const auto res = f.get();
+      world[std::get<0>(res)] = std::get<1>(res);
+    }
+    for (const auto &itr : world) {
+      const auto x = std::get<0>(itr.first);
+      const auto y = std::get<1>(itr.first);
+      const auto z = std::get<2>(itr.first);
+      link_neighbor<face::back, face::front>(world, itr.second,
+                                             chunk_key{ x, y, z + 1 });
+      link_neighbor<face::right, face::left>(world, itr.second,
+                                             chunk_key{ x + 1, y, z });
+      link_neighbor<face::top, face::bottom>(world, itr.second,
+                                             chunk_key{ x, y + 1, z });
+    }
+  });
+  report("world/workers", jobs.number_of_workers(), "threads");
+  report("world/generate", generate_time, "s");
+  // What SPACE in the game used to cost, against the maintained counts
+  std::size_t scanned_solid = 0;
+  const auto scan_time = time_it([&]() {
+    for (const auto &itr : world) {
+      for_each_voxel(*itr.second, [&scanned_solid](
+          chunk &c, const local_size_t x, const local_size_t y,
+          const local_size_t z) { scanned_solid += c.is_solid(x, y, z); });
+    }
+  });
+  std::size_t counted_solid = 0, empty = 0, full = 0, skipped = 0;
+  const auto count_time = time_it([&]() {
+    for (const auto &itr : world) {
+      const auto &c = *itr.second;
+      counted_solid += c.count_solid_blocks();
+      empty += c.is_empty();
+      full += c.is_full();
+      skipped += !chunk_mesher::has_visible_faces(c);
+    }
+  });
+  if (scanned_solid != counted_solid) {
+    std::cerr << "world: solid block counts differ" << std::endl;
+  }
+  report("world/statistics/voxel_scan", scan_time * 1e3, "ms");
+  report("world/statistics/counts", count_time * 1e3, "ms");
+  report("world/statistics/solid_blocks", counted_solid, "blocks");
+  report("world/statistics/empty_chunks", empty, "chunks");
+  report("world/statistics/full_chunks", full, "chunks");
+  report("world/statistics/mesh_skipped", skipped, "chunks");
+  for (const auto mode : { mesh_mode::naive, mesh_mode::greedy }) {
+    const auto name = std::string{ "world/" } +
+                      (mode == mesh_mode::naive ? "naive" : "greedy");
+    // This thread plays the GL thread: it snapshots and requests meshes and
+    // drains the finished ones, the workers build them
+    mesh_queue queue{ jobs };
+    queue.set_mesh_mode(mode);
+    std::size_t vertices = 0;
+    std::size_t refused = 0;
+    double main_thread_time = 0.0;
+    const auto mesh_time = time_it([&]() {
+      auto next = world.cbegin();
+      while (next != world.cend() || queue.size() > 0) {
+        main_thread_time += time_it([&]() {
+          while (next != world.cend()) {
+            if (!queue.request(next->first, *next->second)) {
+              ++refused;
+              break;
+            }
+            ++next;
+          }
+          queue.drain(16, [&vertices](const chunk_key &, std::size_t,
+                                      const buffer_data &mesh_data,
+                                      const chunk_connectivity &) {
+            vertices += mesh_data.size();
+          });
+        });
+        std::this_thread::yield();
+      }
+    });
+    report(name + "/mesh", mesh_time, "s");
+    report(name + "/main_thread", main_thread_time, "s");
+    report(name + "/backpressure", refused, "refused requests");
+    report(name + "/total", generate_time + mesh_time, "s");
+    report(name + "/vertices", vertices, "vertices");
+    const auto sections =
+        queue.get_meshed_sections() + queue.get_skipped_sections();
+    report(name + "/skipped_sections",
+           100.0 * queue.get_skipped_sections() / std::max<std::size_t>(
+                                                      sections, 1),
+           "%");
+  }
+  bench_occlusion(world);
+  bench_lod(world);
+  bench_world_storage(world);
+  report_workers("world", jobs);
+}
+} // namespace
+
+// usage: bench.bin [iterations] [noise|generate|mesh|storage|region|map|cull|world ...]
+int main(int argc, char *argv[]) {
+  const int iterations = argc > 1 ? std::atoi(argv[1]) : 64;
+  const std::vector<std::string> sections(argv + std::min(argc, 2),
+                                          argv + argc);
+  const auto enabled = [&sections](const std::string &name) {
+    return sections.empty() ||
+           std::find(sections.begin(), sections.end(), name) != sections.end();
+  };
+  std::cout << "chunk: " << (int)chunk::width << "x" << (int)chunk::height
+            << "x" << (int)chunk::depth << ", world: " << (int)world_width
+            << "x" << (int)world_height << "x" << (int)world_depth
+            << " chunks, iterations: " << iterations << std::endl;
+  if (enabled("noise")) {
+    bench_noise(iterations);
+  }
+  if (enabled("generate")) {
+    bench_generators(iterations);
+  }
+  if (enabled("mesh")) {
+    bench_meshing(iterations);
+  }
+  if (enabled("storage")) {
+    bench_storage(iterations);
+  }
+  if (enabled("region")) {
+    bench_regions(iterations);
+  }
+  if (enabled("map")) {
+    bench_chunk_maps();
+  }
+  if (enabled("cull")) {
+    bench_culling(iterations);
+  }
+  if (enabled("timing")) {
+    bench_timing(iterations);
+  }
+  if (enabled("alloc")) {
+    bench_allocations(iterations);
+  }
+  if (enabled("world")) {
+    bench_world();
+  }
+}
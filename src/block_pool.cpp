@@ -0,0 +1,65 @@
+#include "block_pool.hpp"
+
+namespace lexov {
+
+void *block_pool::allocate(const std::size_t bytes) {
+  {
+    std::lock_guard<std::mutex> lock{ mutex };
+    ++statistics.live_blocks;
+    for (auto &list : free_lists) {
+      if (list.first == bytes && !list.second.empty()) {
+        const auto p = list.second.back();
+        list.second.pop_back();
+        --statistics.free_blocks;
+        ++statistics.reuses;
+        return p;
+      }
+    }
+    ++statistics.heap_allocations;
+  }
+  try {
+    return ::operator new(bytes);
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock{ mutex };
+    --statistics.live_blocks;
+    --statistics.heap_allocations;
+    throw;
+  }
+}
+
+void block_pool::deallocate(void *p, const std::size_t bytes) {
+  std::lock_guard<std::mutex> lock{ mutex };
+  --statistics.live_blocks;
+  ++statistics.free_blocks;
+  for (auto &list : free_lists) {
+    if (list.first == bytes) {
+      list.second.push_back(p);
+      return;
+    }
+  }
+  free_lists.emplace_back(bytes, std::vector<void *>{ p });
+}
+
+void block_pool::release() {
+  std::lock_guard<std::mutex> lock{ mutex };
+  for (auto &list : free_lists) {
+    for (const auto p : list.second) {
+      ::operator delete(p);
+    }
+  }
+  free_lists.clear();
+  statistics.free_blocks = 0;
+}
+
+pool_statistics block_pool::get_statistics() const {
+  std::lock_guard<std::mutex> lock{ mutex };
+  return statistics;
+}
+
+block_pool &chunk_pool() {
+  static auto pool = new block_pool;
+  return *pool;
+}
+
+} // namespace lexov
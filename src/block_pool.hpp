@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace lexov {
+
+// Allocation counters of a block_pool
+struct pool_statistics {
+  // Blocks taken from the heap, constant once streaming reaches a steady
+  // state
+  std::size_t heap_allocations;
+  // Blocks handed out again from a free list
+  std::size_t reuses;
+  // Blocks in use and blocks waiting to be reused
+  std::size_t live_blocks;
+  std::size_t free_blocks;
+};
+
+// Recycles blocks of a few fixed sizes instead of returning them to the heap.
+// Chunks and snapshots are tens of KB each and streaming churns through
+// thousands of them, with the pool their memory is allocated once. Blocks
+// may be freed on another thread than the one that allocated them.
+class block_pool {
+public:
+  block_pool() = default;
+  ~block_pool() { release(); }
+  block_pool(const block_pool &) = delete;
+  block_pool &operator=(const block_pool &) = delete;
+
+  void *allocate(const std::size_t bytes);
+  void deallocate(void *p, const std::size_t bytes);
+  // Returns the free blocks to the heap
+  void release();
+  pool_statistics get_statistics() const;
+
+private:
+  mutable std::mutex mutex;
+  // Free blocks per block size, there are only a handful of sizes
+  std::vector<std::pair<std::size_t, std::vector<void *>>> free_lists;
+  pool_statistics statistics{};
+};
+
+// Pool of the chunks made by make_chunk and of the mesh snapshots. It is
+// never destroyed, chunks may outlive any static object.
+block_pool &chunk_pool();
+
+// Allocator for std::allocate_shared that takes the block holding the
+// object and its control block from chunk_pool
+template <class T> struct pool_allocator {
+  using value_type = T;
+
+  pool_allocator() = default;
+  template <class U> pool_allocator(const pool_allocator<U> &) {}
+
+  T *allocate(const std::size_t n) {
+    return static_cast<T *>(chunk_pool().allocate(n * sizeof(T)));
+  }
+  void deallocate(T *p, const std::size_t n) {
+    chunk_pool().deallocate(p, n * sizeof(T));
+  }
+};
+
+template <class T, class U>
+bool operator==(const pool_allocator<T> &, const pool_allocator<U> &) {
+  return true;
+}
+template <class T, class U>
+bool operator!=(const pool_allocator<T> &, const pool_allocator<U> &) {
+  return false;
+}
+
+// std::make_shared with the object taken from chunk_pool
+template <class T, class... Args>
+std::shared_ptr<T> make_pooled(Args &&... args) {
+  return std::allocate_shared<T>(pool_allocator<T>{},
+                                 std::forward<Args>(args)...);
+}
+
+} // namespace lexov
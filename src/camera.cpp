@@ -13,6 +13,10 @@ std::array<float, 3> camera::get_position() const {
   return vec3_to_array(position);
 }
 
+std::array<float, 3> camera::get_forward() const {
+  return vec3_to_array(glm::normalize(forward()));
+}
+
 void camera::set_position(const float x, const float y, const float z) {
   view_dirty = true;
   position = glm::vec3{ x, y, z };
@@ -31,6 +31,8 @@ class camera {
 public:
   camera(camera_properties properties);
   std::array<float, 3> get_position() const;
+  // Unit vector the camera looks along
+  std::array<float, 3> get_forward() const;
   void set_position(const float x, const float y, const float z);
   void move_forward(const float dz);
   void move_right(const float dx);
@@ -1,7 +1,8 @@
 #version 410
 
-in vec4 f_world_pos;
 in float f_depth;
+flat in int f_face;
+flat in int f_type;
 uniform samplerBuffer my_texture;
 out vec4 out_color;
 
@@ -80,11 +81,23 @@ vec3 gamma(vec3 color){
     return pow(color, vec3(1.0/2.0));
 }
 
+// Indexed by lexov::face: front, back, left, right, top, bottom
+const vec3 normals[6] = vec3[6](
+    vec3( 0.0,  0.0, -1.0),
+    vec3( 0.0,  0.0,  1.0),
+    vec3(-1.0,  0.0,  0.0),
+    vec3( 1.0,  0.0,  0.0),
+    vec3( 0.0,  1.0,  0.0),
+    vec3( 0.0, -1.0,  0.0)
+);
+const int top_face = 4;
+
 void main() {
-  vec3 normal = normalize(cross(dFdy(f_world_pos.xyz), dFdx(f_world_pos.xyz)));
-  int ind    = int(f_world_pos.w);
+  vec3 normal = normals[f_face];
+  int ind    = f_type;
   int offset = 4 * ind; 
-  if (abs(normal.y - 1.0) < 1e-5 && ind == 2) {
+  // dirt under the open sky is grass
+  if (f_face == top_face && ind == 2) {
     offset = 4;
   }
   float r = texelFetch(my_texture, offset + 0).r;
@@ -1,15 +1,43 @@
 #pragma once
 #include "types.hpp"
+#include "block_pool.hpp"
 #include "chunk_array.hpp"
+#include "chunk_octree.hpp"
+#include "chunk_padded.hpp"
+#include "chunk_palette.hpp"
 #include <memory>
 
 namespace lexov {
 
-using chunk = array_chunk<chunk_width, chunk_height, chunk_depth>;
+// Every storage backend is used through the chunk interface
+using chunk = chunk_base<chunk_width, chunk_height, chunk_depth>;
+using dense_chunk = array_chunk<chunk_width, chunk_height, chunk_depth>;
+using compact_chunk = palette_chunk<chunk_width, chunk_height, chunk_depth>;
+using sparse_chunk = octree_chunk<chunk_width, chunk_height, chunk_depth>;
+using chunk_snapshot = padded_chunk<chunk_width, chunk_height, chunk_depth>;
 
 using chunk_ptr = std::shared_ptr<chunk>;
 using weak_chunk_ptr = std::weak_ptr<chunk>;
 
+// Storage backends that generators and the chunk_manager can pick from
+enum class chunk_storage : std::uint_least8_t {
+  array, palette, octree
+};
+
+// The chunk is taken from chunk_pool and goes back to it once the last
+// chunk_ptr to it is gone, e.g. after chunk_manager::remove_chunk
+inline chunk_ptr make_chunk(const chunk_storage storage) {
+  switch (storage) {
+  case chunk_storage::palette:
+    return make_pooled<compact_chunk>();
+  case chunk_storage::octree:
+    return make_pooled<sparse_chunk>();
+  case chunk_storage::array:
+  default:
+    return make_pooled<dense_chunk>();
+  }
+}
+
 template <class Function>
 inline void for_each_voxel(chunk &c, const Function &f) {
   for (auto z = 0; z < chunk::depth; ++z) {
@@ -5,12 +5,17 @@ uniform vec3 chunk_pos;
 uniform mat4 vp_matrix;
 uniform mat4 v_matrix;
 
-out vec4 f_world_pos;
 out float f_depth;
+// cube_pos.w packs the face into the high and the block type into the low
+// four bits, see voxel_vertex
+flat out int f_face;
+flat out int f_type;
 
 void main() {
   vec4 pos = vec4(cube_pos.xyz + chunk_pos, 1);
   f_depth = length((v_matrix * pos).xyz);
-  f_world_pos = cube_pos;
+  int face_type = int(cube_pos.w);
+  f_face = face_type >> 4;
+  f_type = face_type & 15;
   gl_Position = vp_matrix * pos;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include "chunk_base.hpp"
 #include "types.hpp"
+#include <algorithm>
 #include <array>
 
 namespace lexov {
@@ -12,16 +13,29 @@ public:
 
 private:
   using chunk_data = std::array<block_type, chunk_base_whd::volume>;
+  using occupancy = typename chunk_base_whd::occupancy;
   chunk_data data{};
+  // Kept in sync with data by set_impl
+  occupancy columns{};
 
   block_type get_impl(const local_size_t x, const local_size_t y,
                       const local_size_t z) const override;
-  void set_impl(const local_size_t x, const local_size_t y,
-                const local_size_t z, const block_type type) override;
+  block_type set_impl(const local_size_t x, const local_size_t y,
+                      const local_size_t z, const block_type type) override;
   bool is_solid_impl(const local_size_t x, const local_size_t y,
                      const local_size_t z) const override;
   bool is_transparent_impl(const local_size_t x, const local_size_t y,
                            const local_size_t z) const override;
+  void set_row_impl(const local_size_t x, const local_size_t y,
+                    const local_size_t z, const std::size_t n,
+                    const block_type *types, block_type *previous) override;
+  void set_column_impl(const local_size_t x, const local_size_t y,
+                       const local_size_t z, const std::size_t n,
+                       const block_type *types, block_type *previous) override;
+  void get_row_impl(const local_size_t y, const local_size_t z,
+                    block_type *out) const override;
+  void get_occupancy_impl(occupancy &out) const override;
+  std::size_t memory_usage_impl() const override { return sizeof(*this); }
   inline auto get_1D_index(
       const local_size_t x, const local_size_t y,
       const local_size_t z) const -> decltype(chunk_base_whd::volume) {
@@ -37,13 +51,54 @@ array_chunk<W, H, D>::get_impl(const local_size_t x, const local_size_t y,
 }
 
 template <local_size_t W, local_size_t H, local_size_t D>
-void array_chunk<W, H, D>::set_impl(const local_size_t x, const local_size_t y,
-                                    const local_size_t z,
-                                    const block_type type) {
+block_type array_chunk<W, H, D>::set_impl(const local_size_t x,
+                                          const local_size_t y,
+                                          const local_size_t z,
+                                          const block_type type) {
   auto &current_type = data[get_1D_index(x, y, z)];
-  if (current_type != type) {
+  const auto previous = current_type;
+  if (previous != type) {
     current_type = type;
-    chunk_base_whd::mark_dirty();
+    columns[x + W * z].set(y, is_solid_block(type),
+                           is_solid_block(type) && !is_transparent_block(type));
+  }
+  return previous;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void array_chunk<W, H, D>::set_row_impl(const local_size_t x,
+                                        const local_size_t y,
+                                        const local_size_t z,
+                                        const std::size_t n,
+                                        const block_type *types,
+                                        block_type *previous) {
+  const auto row = data.begin() + get_1D_index(x, y, z);
+  std::copy(row, row + n, previous);
+  std::copy(types, types + n, row);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (previous[i] != types[i]) {
+      const auto t = types[i];
+      columns[x + i + W * z].set(y, is_solid_block(t),
+                                 is_solid_block(t) && !is_transparent_block(t));
+    }
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void array_chunk<W, H, D>::set_column_impl(const local_size_t x,
+                                           const local_size_t y,
+                                           const local_size_t z,
+                                           const std::size_t n,
+                                           const block_type *types,
+                                           block_type *previous) {
+  auto &column = columns[x + W * z];
+  auto i = get_1D_index(x, y, z);
+  for (std::size_t k = 0; k < n; ++k, i += W) {
+    previous[k] = data[i];
+    data[i] = types[k];
+    const auto t = types[k];
+    column.set(y + k, is_solid_block(t),
+               is_solid_block(t) && !is_transparent_block(t));
   }
 }
 
@@ -51,15 +106,28 @@ template <local_size_t W, local_size_t H, local_size_t D>
 bool array_chunk<W, H, D>::is_solid_impl(const local_size_t x,
                                          const local_size_t y,
                                          const local_size_t z) const {
-  return data[get_1D_index(x, y, z)] != block_type::air;
+  return is_solid_block(data[get_1D_index(x, y, z)]);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+bool array_chunk<W, H, D>::is_transparent_impl(const local_size_t x,
+                                               const local_size_t y,
+                                               const local_size_t z) const {
+  return is_transparent_block(data[get_1D_index(x, y, z)]);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void array_chunk<W, H, D>::get_row_impl(const local_size_t y,
+                                        const local_size_t z,
+                                        block_type *out) const {
+  // rows along x are contiguous in memory
+  const auto begin = data.cbegin() + get_1D_index(0, y, z);
+  std::copy(begin, begin + W, out);
 }
 
 template <local_size_t W, local_size_t H, local_size_t D>
-bool array_chunk<W, H, D>::is_transparent_impl(const local_size_t,
-                                               const local_size_t,
-                                               const local_size_t) const {
-  // return data[get_1D_index(x, y, z)] == block_type::water;
-  return false;
+void array_chunk<W, H, D>::get_occupancy_impl(occupancy &out) const {
+  out = columns;
 }
 
 } // namespace lexov
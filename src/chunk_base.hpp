@@ -1,6 +1,11 @@
 #pragma once
+#include "column_mask.hpp"
 #include "types.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 namespace lexov {
 
@@ -11,6 +16,27 @@ public:
   static constexpr local_size_t height = H;
   static constexpr local_size_t depth = D;
   static constexpr std::size_t volume = W * H * D;
+  // Section s holds the layers [s * section_height, (s + 1) * section_height)
+  static constexpr std::size_t sections =
+      (H + section_height - 1) / section_height;
+  static_assert(sections <= 32, "a section_mask holds 32 sections");
+  static constexpr section_mask all_sections =
+      sections == 32 ? ~section_mask{ 0 }
+                     : (section_mask{ 1 } << sections) - 1;
+
+  static constexpr section_mask section_bit(const std::size_t s) {
+    return section_mask{ 1 } << s;
+  }
+  // Sections with voxels on the given face of the chunk
+  static constexpr section_mask border_sections(const face f) {
+    return f == face::top
+               ? section_bit(sections - 1)
+               : f == face::bottom ? section_bit(0) : all_sections;
+  }
+  // One column per (x, z), indexed by x + W * z; bit y is the voxel at y
+  using occupancy = std::array<column_occupancy<H>, W * D>;
+
+  virtual ~chunk_base() = default;
 
   block_type get(const local_size_t x, const local_size_t y,
                  const local_size_t z) const;
@@ -18,12 +44,65 @@ public:
   void set(const local_size_t x, const local_size_t y, const local_size_t z,
            const block_type type);
 
+  // Bulk writes. The block counts, section states and dirty sections of the
+  // chunk and its neighbors are updated once per call rather than once per
+  // voxel, generators and decoders should prefer them. The voxels written
+  // must lie inside the chunk.
+  // Sets the box [x0, x1) x [y0, y1) x [z0, z1) to type
+  void fill(const local_size_t x0, const local_size_t y0,
+            const local_size_t z0, const local_size_t x1,
+            const local_size_t y1, const local_size_t z1,
+            const block_type type);
+  // Sets the n voxels from (x, y, z) on along x to types[0, n)
+  void set_row(const local_size_t x, const local_size_t y,
+               const local_size_t z, const std::size_t n,
+               const block_type *types);
+  // Sets the n voxels from (x, y, z) on along y to types[0, n)
+  void set_column(const local_size_t x, const local_size_t y,
+                  const local_size_t z, const std::size_t n,
+                  const block_type *types);
+  // Sets every voxel (x, y, z) to types[x + W * y + W * H * z]
+  void set_voxels(const block_type *types);
+
   bool is_solid(const local_size_t x, const local_size_t y,
                 const local_size_t z) const;
 
   bool is_transparent(const local_size_t x, const local_size_t y,
                       const local_size_t z) const;
 
+  // Copies the W voxels of the row at (y, z) into out. One call replaces W
+  // calls to get, so bulk readers should prefer it.
+  void get_row(const local_size_t y, const local_size_t z,
+               block_type *out) const;
+
+  // Copies every solid voxel (x, y, z) to out[x + y_stride * y + z_stride *
+  // z]. out must hold air already, backends that know where the air is
+  // skip it instead of copying it voxel by voxel.
+  void get_voxels(block_type *out, const std::size_t y_stride,
+                  const std::size_t z_stride) const;
+
+  // Solid and opaque bitmasks of every column of the chunk
+  void get_occupancy(occupancy &out) const;
+
+  // Block counts are maintained by set, all of these are O(1)
+  std::size_t count_blocks(const block_type type) const {
+    return block_counts[static_cast<std::size_t>(type)];
+  }
+  std::size_t count_solid_blocks() const { return number_of_solid_blocks; }
+  // No solid voxel, nothing to mesh
+  bool is_empty() const { return number_of_solid_blocks == 0; }
+  // Every voxel is opaque, the chunk hides all faces of its neighbors
+  // towards it
+  bool is_full() const;
+  // O(1), kept up to date by set
+  section_state get_section_state(const std::size_t s) const;
+
+  // Lets compressed backends release storage once a chunk is fully built
+  void shrink_to_fit();
+
+  // Approximate heap and inline bytes held by the chunk
+  std::size_t memory_usage() const;
+
   template <face face>
   bool is_face_visible(const local_size_t x, const local_size_t y,
                        const local_size_t z) const;
@@ -31,16 +110,22 @@ public:
   template <face face>
   void set_neighbor(std::shared_ptr<chunk_base const> neighbor);
 
+  template <face face>
+  std::shared_ptr<chunk_base const> get_neighbor() const;
+
+  // Dirty sections need a new mesh
   bool is_dirty() const;
-  void mark_dirty() const;
-  void mark_clean() const;
+  section_mask get_dirty_sections() const;
+  void mark_dirty(const section_mask s = all_sections) const;
+  void mark_clean(const section_mask s = all_sections) const;
 
 private:
   virtual block_type get_impl(const local_size_t x, const local_size_t y,
                               const local_size_t z) const = 0;
 
-  virtual void set_impl(const local_size_t x, const local_size_t y,
-                        const local_size_t z, const block_type type) = 0;
+  // Returns the type that was replaced
+  virtual block_type set_impl(const local_size_t x, const local_size_t y,
+                              const local_size_t z, const block_type type) = 0;
 
   virtual bool is_solid_impl(const local_size_t x, const local_size_t y,
                              const local_size_t z) const = 0;
@@ -48,6 +133,47 @@ private:
   virtual bool is_transparent_impl(const local_size_t x, const local_size_t y,
                                    const local_size_t z) const = 0;
 
+protected:
+  // Default implementations built on the pure virtual accessors. Backends
+  // with contiguous rows or incrementally maintained state should override
+  // them.
+  // Bulk set_impl along x and along y, the replaced types go to previous
+  virtual void set_row_impl(const local_size_t x, const local_size_t y,
+                            const local_size_t z, const std::size_t n,
+                            const block_type *types, block_type *previous);
+  virtual void set_column_impl(const local_size_t x, const local_size_t y,
+                               const local_size_t z, const std::size_t n,
+                               const block_type *types, block_type *previous);
+
+  virtual void get_row_impl(const local_size_t y, const local_size_t z,
+                            block_type *out) const;
+
+  virtual void get_voxels_impl(block_type *out, const std::size_t y_stride,
+                               const std::size_t z_stride) const;
+
+  virtual void get_occupancy_impl(occupancy &out) const;
+
+  virtual void shrink_to_fit_impl();
+
+  virtual std::size_t memory_usage_impl() const;
+
+private:
+  // Sections dirtied by a write, in this chunk and per face in the neighbor
+  struct pending_changes {
+    section_mask own{ 0 };
+    std::array<section_mask, 6> neighbors{};
+  };
+  // Updates the counts for one changed voxel of the given section
+  void count_change(const block_type previous, const block_type type,
+                    const std::size_t section);
+  // Notes the sections a change to voxel (x, y, z) dirties
+  static void note_change(const local_size_t x, const local_size_t y,
+                          const local_size_t z, pending_changes &changes);
+  void apply_changes(const pending_changes &changes) const;
+  void write_row(const local_size_t x, const local_size_t y,
+                 const local_size_t z, const std::size_t n,
+                 const block_type *types, pending_changes &changes);
+
   // Maintain weak pointers to neighboring chunks
   using weak_chunk_ptr = std::weak_ptr<chunk_base const>;
   weak_chunk_ptr front_neighbor;
@@ -57,8 +183,14 @@ private:
   weak_chunk_ptr top_neighbor;
   weak_chunk_ptr bottom_neighbor;
 
-  mutable bool dirty{ false };
-  decltype(volume) number_of_solid_blocks{ 0 };
+  mutable section_mask dirty_sections{ 0 };
+  std::size_t number_of_solid_blocks{ 0 };
+  // Per section, at most W * section_height * D each
+  std::array<std::uint32_t, sections> section_solid_blocks{};
+  std::array<std::uint32_t, sections> section_opaque_blocks{};
+  // Chunks start out as air
+  std::array<std::uint32_t, static_cast<std::size_t>(block_type::count)>
+      block_counts{ { static_cast<std::uint32_t>(volume) } };
 };
 
 template <local_size_t W, local_size_t H, local_size_t D>
@@ -70,35 +202,208 @@ block_type chunk_base<W, H, D>::get(const local_size_t x, const local_size_t y,
 template <local_size_t W, local_size_t H, local_size_t D>
 void chunk_base<W, H, D>::set(const local_size_t x, const local_size_t y,
                               const local_size_t z, const block_type type) {
-  set_impl(x, y, z, type);
-  static const auto mark_neighbor_dirty = [](const weak_chunk_ptr & ptr) {
-    if (auto neighbor = ptr.lock()) {
-      neighbor->mark_dirty();
+  const auto previous = set_impl(x, y, z, type);
+  if (previous == type) {
+    return;
+  }
+  count_change(previous, type, y / section_height);
+  pending_changes changes;
+  note_change(x, y, z, changes);
+  apply_changes(changes);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::fill(const local_size_t x0, const local_size_t y0,
+                               const local_size_t z0, const local_size_t x1,
+                               const local_size_t y1, const local_size_t z1,
+                               const block_type type) {
+  assert(x0 <= x1 && x1 <= W && y0 <= y1 && y1 <= H && z0 <= z1 && z1 <= D);
+  std::array<block_type, W> row;
+  row.fill(type);
+  pending_changes changes;
+  for (local_size_t z = z0; z < z1; ++z) {
+    for (local_size_t y = y0; y < y1; ++y) {
+      write_row(x0, y, z, x1 - x0, row.data(), changes);
     }
   }
-  ;
-  // If we made a change to a border cube, mark the bordering neighbor as dirty
-  if (dirty) {
-    if (x == 0) {
-      mark_neighbor_dirty(left_neighbor);
-    } else if (x == W - 1) {
-      mark_neighbor_dirty(right_neighbor);
+  apply_changes(changes);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::set_row(const local_size_t x, const local_size_t y,
+                                  const local_size_t z, const std::size_t n,
+                                  const block_type *types) {
+  assert(x + n <= W && y < H && z < D);
+  pending_changes changes;
+  write_row(x, y, z, n, types, changes);
+  apply_changes(changes);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::set_column(const local_size_t x,
+                                     const local_size_t y,
+                                     const local_size_t z,
+                                     const std::size_t n,
+                                     const block_type *types) {
+  assert(x < W && y + n <= H && z < D);
+  std::array<block_type, H> previous;
+  set_column_impl(x, y, z, n, types, previous.data());
+  pending_changes changes;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (previous[i] != types[i]) {
+      count_change(previous[i], types[i], (y + i) / section_height);
+      note_change(x, y + i, z, changes);
     }
+  }
+  apply_changes(changes);
+}
 
-    if (y == 0) {
-      mark_neighbor_dirty(bottom_neighbor);
-    } else if (y == H - 1) {
-      mark_neighbor_dirty(top_neighbor);
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::set_voxels(const block_type *types) {
+  pending_changes changes;
+  for (local_size_t z = 0; z < D; ++z) {
+    for (local_size_t y = 0; y < H; ++y) {
+      write_row(0, y, z, W, types + W * y + W * H * z, changes);
     }
+  }
+  apply_changes(changes);
+}
 
-    if (z == 0) {
-      mark_neighbor_dirty(front_neighbor);
-    } else if (z == D - 1) {
-      mark_neighbor_dirty(back_neighbor);
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::write_row(const local_size_t x, const local_size_t y,
+                                    const local_size_t z, const std::size_t n,
+                                    const block_type *types,
+                                    pending_changes &changes) {
+  std::array<block_type, W> previous;
+  set_row_impl(x, y, z, n, types, previous.data());
+  const std::size_t section = y / section_height;
+  std::size_t first = n, last = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (previous[i] != types[i]) {
+      count_change(previous[i], types[i], section);
+      first = std::min(first, i);
+      last = i;
+    }
+  }
+  // only the ends of the changed range can lie on a border along x
+  if (first < n) {
+    note_change(x + first, y, z, changes);
+    note_change(x + last, y, z, changes);
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::count_change(const block_type previous,
+                                       const block_type type,
+                                       const std::size_t section) {
+  --block_counts[static_cast<std::size_t>(previous)];
+  ++block_counts[static_cast<std::size_t>(type)];
+  if (is_solid_block(previous) != is_solid_block(type)) {
+    if (is_solid_block(type)) {
+      ++number_of_solid_blocks;
+      ++section_solid_blocks[section];
+    } else {
+      --number_of_solid_blocks;
+      --section_solid_blocks[section];
+    }
+  }
+  static const auto is_opaque = [](const block_type t) {
+    return is_solid_block(t) && !is_transparent_block(t);
+  };
+  if (is_opaque(previous) != is_opaque(type)) {
+    if (is_opaque(type)) {
+      ++section_opaque_blocks[section];
+    } else {
+      --section_opaque_blocks[section];
     }
   }
 }
 
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::note_change(const local_size_t x,
+                                      const local_size_t y,
+                                      const local_size_t z,
+                                      pending_changes &changes) {
+  const std::size_t section = y / section_height;
+  // Faces across a section border are meshed with the section they belong
+  // to, so edits next to the border dirty the adjacent section as well
+  changes.own |= section_bit(section);
+  if (y % section_height == 0 && section > 0) {
+    changes.own |= section_bit(section - 1);
+  } else if (y % section_height == section_height - 1 &&
+             section + 1 < sections) {
+    changes.own |= section_bit(section + 1);
+  }
+  // A change to a border voxel dirties the bordering section of the
+  // neighbor
+  const auto neighbor = [&changes](const face f, const section_mask s) {
+    changes.neighbors[static_cast<std::size_t>(f)] |= s;
+  };
+  if (x == 0) {
+    neighbor(face::left, section_bit(section));
+  } else if (x == W - 1) {
+    neighbor(face::right, section_bit(section));
+  }
+  if (y == 0) {
+    neighbor(face::bottom, section_bit(sections - 1));
+  } else if (y == H - 1) {
+    neighbor(face::top, section_bit(0));
+  }
+  if (z == 0) {
+    neighbor(face::front, section_bit(section));
+  } else if (z == D - 1) {
+    neighbor(face::back, section_bit(section));
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::apply_changes(const pending_changes &changes) const {
+  mark_dirty(changes.own);
+  static const auto mark_neighbor_dirty = [](const weak_chunk_ptr & ptr,
+                                             const section_mask s) {
+    if (s == 0) {
+      return;
+    }
+    if (auto neighbor = ptr.lock()) {
+      neighbor->mark_dirty(s);
+    }
+  }
+  ;
+  const auto at = [&changes](const face f) {
+    return changes.neighbors[static_cast<std::size_t>(f)];
+  };
+  mark_neighbor_dirty(front_neighbor, at(face::front));
+  mark_neighbor_dirty(back_neighbor, at(face::back));
+  mark_neighbor_dirty(left_neighbor, at(face::left));
+  mark_neighbor_dirty(right_neighbor, at(face::right));
+  mark_neighbor_dirty(top_neighbor, at(face::top));
+  mark_neighbor_dirty(bottom_neighbor, at(face::bottom));
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::set_row_impl(const local_size_t x,
+                                       const local_size_t y,
+                                       const local_size_t z,
+                                       const std::size_t n,
+                                       const block_type *types,
+                                       block_type *previous) {
+  for (std::size_t i = 0; i < n; ++i) {
+    previous[i] = set_impl(x + i, y, z, types[i]);
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::set_column_impl(const local_size_t x,
+                                          const local_size_t y,
+                                          const local_size_t z,
+                                          const std::size_t n,
+                                          const block_type *types,
+                                          block_type *previous) {
+  for (std::size_t i = 0; i < n; ++i) {
+    previous[i] = set_impl(x, y + i, z, types[i]);
+  }
+}
+
 template <local_size_t W, local_size_t H, local_size_t D>
 bool chunk_base<W, H, D>::is_solid(const local_size_t x, const local_size_t y,
                                    const local_size_t z) const {
@@ -112,6 +417,101 @@ bool chunk_base<W, H, D>::is_transparent(const local_size_t x,
   return is_transparent_impl(x, y, z);
 }
 
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::get_row(const local_size_t y, const local_size_t z,
+                                  block_type *out) const {
+  get_row_impl(y, z, out);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::get_row_impl(const local_size_t y,
+                                       const local_size_t z,
+                                       block_type *out) const {
+  for (local_size_t x = 0; x < W; ++x) {
+    out[x] = get_impl(x, y, z);
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::get_voxels(block_type *out,
+                                     const std::size_t y_stride,
+                                     const std::size_t z_stride) const {
+  get_voxels_impl(out, y_stride, z_stride);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::get_voxels_impl(block_type *out,
+                                          const std::size_t y_stride,
+                                          const std::size_t z_stride) const {
+  for (local_size_t z = 0; z < D; ++z) {
+    for (local_size_t y = 0; y < H; ++y) {
+      get_row_impl(y, z, out + y_stride * y + z_stride * z);
+    }
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::get_occupancy(occupancy &out) const {
+  get_occupancy_impl(out);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::get_occupancy_impl(occupancy &out) const {
+  std::array<block_type, W> row;
+  for (local_size_t z = 0; z < D; ++z) {
+    for (local_size_t y = 0; y < H; ++y) {
+      get_row_impl(y, z, row.data());
+      for (local_size_t x = 0; x < W; ++x) {
+        const auto t = row[x];
+        out[x + W * z].set(y, is_solid_block(t),
+                           is_solid_block(t) && !is_transparent_block(t));
+      }
+    }
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+bool chunk_base<W, H, D>::is_full() const {
+  std::size_t opaque = 0;
+  for (std::size_t t = 0; t < block_counts.size(); ++t) {
+    const auto type = static_cast<block_type>(t);
+    if (is_solid_block(type) && !is_transparent_block(type)) {
+      opaque += block_counts[t];
+    }
+  }
+  return opaque == volume;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+section_state
+chunk_base<W, H, D>::get_section_state(const std::size_t s) const {
+  const std::size_t layers =
+      s + 1 < sections ? section_height : H - s * section_height;
+  if (section_solid_blocks[s] == 0) {
+    return section_state::empty;
+  }
+  return section_opaque_blocks[s] == W * layers * D ? section_state::full
+                                                    : section_state::mixed;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::shrink_to_fit() {
+  shrink_to_fit_impl();
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void chunk_base<W, H, D>::shrink_to_fit_impl() {}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+std::size_t chunk_base<W, H, D>::memory_usage() const {
+  return memory_usage_impl();
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+std::size_t chunk_base<W, H, D>::memory_usage_impl() const {
+  return sizeof(*this);
+}
+
 template <local_size_t W, local_size_t H, local_size_t D>
 template <face face>
 bool chunk_base<W, H, D>::is_face_visible(const local_size_t x,
@@ -174,7 +574,7 @@ template <local_size_t W, local_size_t H, local_size_t D>
 template <face face>
 void
 chunk_base<W, H, D>::set_neighbor(std::shared_ptr<chunk_base const> neighbor) {
-  mark_dirty();
+  mark_dirty(border_sections(face));
   switch (face) {
   case face::front:
     front_neighbor = neighbor;
@@ -197,19 +597,44 @@ chunk_base<W, H, D>::set_neighbor(std::shared_ptr<chunk_base const> neighbor) {
   }
 }
 
+template <local_size_t W, local_size_t H, local_size_t D>
+template <face face>
+std::shared_ptr<chunk_base<W, H, D> const>
+chunk_base<W, H, D>::get_neighbor() const {
+  switch (face) {
+  case face::front:
+    return front_neighbor.lock();
+  case face::back:
+    return back_neighbor.lock();
+  case face::left:
+    return left_neighbor.lock();
+  case face::right:
+    return right_neighbor.lock();
+  case face::top:
+    return top_neighbor.lock();
+  case face::bottom:
+    return bottom_neighbor.lock();
+  }
+}
+
 template <local_size_t W, local_size_t H, local_size_t D>
 bool chunk_base<W, H, D>::is_dirty() const {
-  return dirty;
+  return dirty_sections != 0;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+section_mask chunk_base<W, H, D>::get_dirty_sections() const {
+  return dirty_sections;
 }
 
 template <local_size_t W, local_size_t H, local_size_t D>
-void chunk_base<W, H, D>::mark_dirty() const {
-  dirty = true;
+void chunk_base<W, H, D>::mark_dirty(const section_mask s) const {
+  dirty_sections |= s;
 }
 
 template <local_size_t W, local_size_t H, local_size_t D>
-void chunk_base<W, H, D>::mark_clean() const {
-  dirty = false;
+void chunk_base<W, H, D>::mark_clean(const section_mask s) const {
+  dirty_sections &= ~s;
 }
 
 } // namespace lexov
@@ -0,0 +1,58 @@
+#pragma once
+#include "types.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lexov {
+
+  // Corner of a quad. The fourth byte packs the block type into the low four
+  // bits and the face, which gives the normal, into the high four bits.
+  struct voxel_vertex {
+    voxel_vertex(std::uint8_t x, std::uint8_t y, std::uint8_t z, face f,
+                 block_type t)
+        : x{ x }, y{ y }, z{ z },
+          face_type{ static_cast<std::uint8_t>(static_cast<unsigned>(f) << 4 |
+                                               static_cast<unsigned>(t)) } {}
+    std::uint8_t x;
+    std::uint8_t y;
+    std::uint8_t z;
+    std::uint8_t face_type;
+
+    block_type get_type() const {
+      return static_cast<block_type>(face_type & 0xf);
+    }
+    face get_face() const { return static_cast<face>(face_type >> 4); }
+  };
+  static_assert(sizeof(voxel_vertex) == 4, "voxel_vertex is uploaded as is");
+
+  // CPU side vertex data for a chunk mesh, independent of any GL objects.
+  // Every quad takes four consecutive vertices and is drawn as the triangles
+  // (0, 1, 2) and (2, 3, 0) through a shared index buffer.
+  using buffer_data = std::vector<voxel_vertex>;
+
+  constexpr const std::size_t vertices_per_quad = 4;
+  constexpr const std::size_t indices_per_quad = 6;
+  using quad_index = std::uint16_t;
+  // Faces of one section: at most every other voxel shows all six faces,
+  // plus the faces on the surface of the section
+  constexpr const std::size_t max_section_quads =
+      chunk_width * section_height * chunk_depth / 2 * 6 +
+      2 * (chunk_width * chunk_depth + chunk_width * section_height +
+           chunk_depth * section_height);
+  static_assert(max_section_quads * vertices_per_quad <= 0x10000,
+                "section meshes are indexed with quad_index");
+
+  // Indices for the first quads quads of a buffer_data
+  inline std::vector<quad_index> make_quad_indices(const std::size_t quads) {
+    static const quad_index pattern[indices_per_quad] = { 0, 1, 2, 2, 3, 0 };
+    std::vector<quad_index> indices;
+    indices.reserve(quads * indices_per_quad);
+    for (std::size_t q = 0; q < quads; ++q) {
+      for (const auto i : pattern) {
+        indices.push_back(static_cast<quad_index>(q * vertices_per_quad + i));
+      }
+    }
+    return indices;
+  }
+} // namespace lexov
@@ -1,295 +1,278 @@
 #include "chunk_generator.hpp"
+#include "noise.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
 #include <memory>
-#include <random>
 #include <thread>
+#include <vector>
 
 namespace {
-float grad[12][3] = { { 1.0, 1.0, 0.0 }, { -1.0, 1.0, 0.0 }, { 1.0, -1.0, 0.0 },
-                      { -1.0, -1.0, 0.0 }, { 1.0, 0.0, 1.0 },
-                      { -1.0, 0.0, 1.0 }, { 1.0, 0.0, -1.0 },
-                      { -1.0, 0.0, -1.0 }, { 0.0, 1.0, 1.0 },
-                      { 0.0, -1.0, 1.0 }, { 0.0, 1.0, -1.0 },
-                      { 0.0, -1.0, -1.0 } };
-
-int perm[512] = {
-  151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140,
-  36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234,
-  75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237,
-  149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48,
-  27, 166, 77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133, 230, 220, 105,
-  92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161, 1, 216, 80, 73,
-  209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130, 116, 188, 159, 86,
-  164, 100, 109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38,
-  147, 118, 126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189,
-  28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101,
-  155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232,
-  178, 185, 112, 104, 218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12,
-  191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31,
-  181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254,
-  138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215,
-  61, 156, 180, 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233,
-  7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
-  247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57,
-  177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165,
-  71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133,
-  230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161, 1,
-  216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130, 116,
-  188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124,
-  123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16,
-  58, 17, 182, 189, 28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163,
-  70, 221, 153, 101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110,
-  79, 113, 224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251, 34, 242, 193,
-  238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107,
-  49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45,
-  127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128,
-  195, 78, 66, 215, 61, 156, 180
-};
-
-float dot(float x, float y, float z, float *g) {
-  return x * g[0] + y * g[1] + z * g[2];
-}
-
-float noise(float xin, float yin, float zin) {
-  float F3, G3, t, X0, Y0, Z0, x0, y0, z0, s, x1, y1, z1, x2, y2, z2, x3, y3,
-      z3, t0, t1, t2, t3, n0, n1, n2, n3;
-  int i, j, k, ii, jj, kk, i1, j1, k1, i2, j2, k2, gi0, gi1, gi2, gi3;
-
-  F3 = 1.0 / 3.0;
-  s = (xin + yin + zin) * F3;
-  i = xin + s;
-  j = yin + s;
-  k = zin + s;
-  G3 = 1.0 / 6.0;
-  t = (i + j + k) * G3;
-  X0 = i - t;
-  Y0 = j - t;
-  Z0 = k - t;
-  x0 = xin - X0;
-  y0 = yin - Y0;
-  z0 = zin - Z0;
-
-  if (x0 >= y0) {
-    if (y0 >= z0) {
-      i1 = 1;
-      j1 = 0;
-      k1 = 0;
-      i2 = 1;
-      j2 = 1;
-      k2 = 0;
-    } else if (x0 >= z0) {
-      i1 = 1;
-      j1 = 0;
-      k1 = 0;
-      i2 = 1;
-      j2 = 0;
-      k2 = 1;
-    } else {
-      i1 = 0;
-      j1 = 0;
-      k1 = 1;
-      i2 = 1;
-      j2 = 0;
-      k2 = 1;
-    }
-  } else {
-    if (y0 < z0) {
-      i1 = 0;
-      j1 = 0;
-      k1 = 1;
-      i2 = 0;
-      j2 = 1;
-      k2 = 1;
-    } else if (x0 < z0) {
-      i1 = 0;
-      j1 = 1;
-      k1 = 0;
-      i2 = 0;
-      j2 = 1;
-      k2 = 1;
-    } else {
-      i1 = 0;
-      j1 = 1;
-      k1 = 0;
-      i2 = 1;
-      j2 = 1;
-      k2 = 0;
-    }
-  }
-
-  x1 = x0 - i1 + G3;
-  y1 = y0 - j1 + G3;
-  z1 = z0 - k1 + G3;
-  x2 = x0 - i2 + 2.0 * G3;
-  y2 = y0 - j2 + 2.0 * G3;
-  z2 = z0 - k2 + 2.0 * G3;
-  x3 = x0 - 1.0 + 3.0 * G3;
-  y3 = y0 - 1.0 + 3.0 * G3;
-  z3 = z0 - 1.0 + 3.0 * G3;
-
-  ii = i & 255;
-  jj = j & 255;
-  kk = k & 255;
-
-  gi0 = perm[ii + perm[jj + perm[kk]]] % 12;
-  gi1 = perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12;
-  gi2 = perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12;
-  gi3 = perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12;
-
-  t0 = 0.6 - x0 * x0 - y0 * y0 - z0 * z0;
-  if (t0 < 0) {
-    n0 = 0.0;
-  } else {
-    t0 *= t0;
-    n0 = t0 * t0 * dot(x0, y0, z0, grad[gi0]);
-  }
-
-  t1 = 0.6 - x1 * x1 - y1 * y1 - z1 * z1;
-  if (t1 < 0) {
-    n1 = 0.0;
-  } else {
-    t1 *= t1;
-    n1 = t1 * t1 * dot(x1, y1, z1, grad[gi1]);
-  }
-
-  t2 = 0.6 - x2 * x2 - y2 * y2 - z2 * z2;
-  if (t2 < 0) {
-    n2 = 0.0;
-  } else {
-    t2 *= t2;
-    n2 = t2 * t2 * dot(x2, y2, z2, grad[gi2]);
-  }
-
-  t3 = 0.6 - x3 * x3 - y3 * y3 - z3 * z3;
-  if (t3 < 0) {
-    n3 = 0.0;
+float plateau_falloff(const float yf) {
+  if (yf <= 0.8) {
+    return 1.0;
+  } else if (0.8 < yf && yf < 0.9) {
+    return 1.0 - (yf - 0.8) * 10.0;
   } else {
-    t3 *= t3;
-    n3 = t3 * t3 * dot(x3, y3, z3, grad[gi3]);
+    return 0.0;
   }
-
-  return 16.0 * (n0 + n1 + n2 + n3) + 1.0;
-}
-
-float simplex_noise(int octaves, float x, float y, float z) {
-  float value = 0.0;
-  int i;
-  for (i = 0; i < octaves; i++) {
-    value += noise(x * pow(2, i), y * pow(2, i), z * pow(2, i));
-  }
-  return value;
 }
 }
 
 namespace lexov {
-chunk_ptr chunk_generator::make_solid_chunk(const block_type type) {
-  const static auto fill = [&type](chunk & c, const local_size_t x,
-                                   const local_size_t y, const local_size_t z) {
-    c.set(x, y, z, type);
-  }
-  ;
-  auto shared_chunk = std::make_shared<chunk>();
-  for_each_voxel(*shared_chunk, fill);
+chunk_ptr chunk_generator::make_solid_chunk(const block_type type,
+                                           const chunk_storage storage) {
+  auto shared_chunk = make_chunk(storage);
+  shared_chunk->fill(0, 0, 0, chunk::width, chunk::height, chunk::depth, type);
+  shared_chunk->shrink_to_fit();
   return shared_chunk;
 }
-;
 
-chunk_ptr chunk_generator::make_random_chunk(const double p) {
-  std::random_device rd;
-  std::default_random_engine e{ rd() };
-  std::uniform_int_distribution<> dis(1, (int)block_type::count);
-  const static auto fill = [&dis, &e, &p](chunk & c, const local_size_t x,
-                                          const local_size_t y,
-                                          const local_size_t z) {
-    auto r = std::generate_canonical<double, 10>(e);
-    if (r > p) {
-      c.set(x, y, z, (block_type)dis(e));
+chunk_ptr chunk_generator::make_random_chunk(const chunk_key key,
+                                            const double p,
+                                            const chunk_storage storage,
+                                            const world_seed seed) {
+  const auto world_x = std::get<0>(key) * chunk_width;
+  const auto world_y = std::get<1>(key) * chunk_height;
+  const auto world_z = std::get<2>(key) * chunk_depth;
+  const auto fill = [&](chunk & c, const local_size_t x,
+                        const local_size_t y,
+                        const local_size_t z) {
+    const auto bits =
+        noise::hash(seed, world_x + x, world_y + y, world_z + z);
+    if (noise::to_unit(bits) > p) {
+      // any solid type
+      const auto types = static_cast<unsigned>(block_type::count) - 1;
+      c.set(x, y, z, (block_type)(1 + (bits >> 32) % types));
     }
   }
   ;
-  auto shared_chunk = std::make_shared<chunk>();
+  auto shared_chunk = make_chunk(storage);
   for_each_voxel(*shared_chunk, fill);
+  shared_chunk->shrink_to_fit();
   return shared_chunk;
 }
 
-chunk_ptr chunk_generator::make_pyramid() {
-  std::random_device rd;
-  std::default_random_engine e{ rd() };
-  std::uniform_int_distribution<> dis(1, 2);
-  const static auto build_pyramid = [&dis, &e](chunk & c, const local_size_t x,
-                                               const local_size_t y,
-                                               const local_size_t z) {
-    if (x >= 0 + y && x <= chunk::width - y && z >= 0 + y &&
-        z <= chunk::depth - y) {
-      block_type t;
-      if (y == 0)
-        t = block_type::dirt;
-      else if (y < 3 || y > 15)
-        t = block_type::grass;
-      else
-        t = (block_type)dis(e);
-      c.set(x, y, z, t);
-    } else if (y < 3) {
-      c.set(x, y, z, block_type::water);
+chunk_ptr chunk_generator::make_pyramid(const chunk_storage storage,
+                                       const world_seed seed) {
+  auto shared_chunk = make_chunk(storage);
+  auto &c = *shared_chunk;
+  std::array<block_type, chunk::width> row;
+  // The pyramid narrows by a voxel per layer and is gone above width / 2,
+  // water surrounds its lowest three layers
+  const int layers = std::max(chunk::width / 2 + 1, 3);
+  for (local_size_t y = 0; y < layers; ++y) {
+    for (local_size_t z = 0; z < chunk::depth; ++z) {
+      for (local_size_t x = 0; x < chunk::width; ++x) {
+        auto &t = row[x];
+        if (x >= 0 + y && x <= chunk::width - y && z >= 0 + y &&
+            z <= chunk::depth - y) {
+          if (y == 0)
+            t = block_type::dirt;
+          else if (y < 3 || y > 15)
+            t = block_type::grass;
+          else
+            t = (block_type)(1 + (noise::hash(seed, x, y, z) & 1));
+        } else {
+          t = y < 3 ? block_type::water : block_type::air;
+        }
+      }
+      c.set_row(0, y, z, chunk::width, row.data());
     }
   }
-  ;
-  auto shared_chunk = std::make_shared<chunk>();
-  for_each_voxel(*shared_chunk, build_pyramid);
+  shared_chunk->shrink_to_fit();
   return shared_chunk;
 }
 
 std::tuple<chunk_key, chunk_ptr>
-chunk_generator::make_floating_rock(const chunk_key key) {
-  std::random_device rd;
-  std::default_random_engine e{ rd() };
-  std::uniform_real_distribution<> dirt_dist(.4, .7);
-  std::uniform_real_distribution<> grass_dist(.8, .9);
+chunk_generator::make_floating_rock(const chunk_key key,
+                                    const chunk_storage storage,
+                                    const world_seed seed,
+                                    const local_size_t lattice_spacing) {
+  const std::size_t s = lattice_spacing;
+  assert(is_lattice_spacing(lattice_spacing));
+  // The seed moves the world to another part of the noise fields
+  std::array<float, 3> offset;
+  for (int axis = 0; axis < 3; ++axis) {
+    offset[axis] = noise::to_unit(noise::hash(seed, axis, 0, 0)) * 256.0f;
+  }
   const auto world_x = std::get<0>(key) * chunk_width;
   const auto world_y = std::get<1>(key) * chunk_height;
   const auto world_z = std::get<2>(key) * chunk_depth;
-  thread_local const auto build_rock =
-      [&dirt_dist, &grass_dist, &e, &world_x, &world_y, &world_z](
-          chunk & c, local_size_t x, local_size_t y, local_size_t z) {
-    float caves, center_falloff, plateau_falloff, density;
-    float xf = (world_x + x) / ((float)world_width * chunk_width),
-          yf = (world_y + y) / ((float)world_height * chunk_height),
-          zf = (world_z + z) / ((float)world_depth * chunk_depth);
-    if (yf <= 0.8) {
-      plateau_falloff = 1.0;
-    } else if (0.8 < yf && yf < 0.9) {
-      plateau_falloff = 1.0 - (yf - 0.8) * 10.0;
-    } else {
-      plateau_falloff = 0.0;
+  auto shared_chunk = make_chunk(storage);
+  auto &c = *shared_chunk;
+
+  // Noise is evaluated a whole column at a time through the batch API. The
+  // expensive density octaves are only evaluated for voxels outside of caves.
+  using column = std::array<float, chunk::height>;
+  column yf, plateau, caves, density, octaves, detail, px, py, pz;
+  // the falloff terms are summed in double like the expression they come from
+  std::array<double, chunk::height> falloff_y;
+  std::array<local_size_t, chunk::height> rock;
+  for (local_size_t y = 0; y < chunk::height; ++y) {
+    yf[y] = (world_y + y) / ((float)world_height * chunk_height);
+    falloff_y[y] = pow((yf[y] - 1.0) * 0.8, 2);
+    plateau[y] = plateau_falloff(yf[y]);
+  }
+  const auto to_xf = [](const world_size_t x) {
+    return x / ((float)world_width * chunk_width);
+  };
+  const auto to_zf = [](const world_size_t z) {
+    return z / ((float)world_depth * chunk_depth);
+  };
+  // Evaluates the three fields at the n heights yf of column (xf, zf)
+  const auto sample = [&](const float xf, const float *yf, const float zf,
+                          const std::size_t n, float *caves, float *octaves,
+                          float *detail) {
+    for (std::size_t i = 0; i < n; ++i) {
+      px[i] = xf * 5 + offset[0];
+      py[i] = yf[i] * 5 + offset[1];
+      pz[i] = zf * 5 + offset[2];
+    }
+    noise::simplex_batch(px.data(), py.data(), pz.data(), caves, n);
+    for (std::size_t i = 0; i < n; ++i) {
+      px[i] = xf + offset[0];
+      py[i] = yf[i] * 0.5 + offset[1];
+      pz[i] = zf + offset[2];
     }
+    noise::simplex_octaves_batch(5, px.data(), py.data(), pz.data(), octaves,
+                                 n);
+    for (std::size_t i = 0; i < n; ++i) {
+      px[i] = (xf + 1) * 3.0 + offset[0];
+      py[i] = (yf[i] + 1) * 3.0 + offset[1];
+      pz[i] = (zf + 1) * 3.0 + offset[2];
+    }
+    noise::simplex_batch(px.data(), py.data(), pz.data(), detail, n);
+  };
 
-    caves = pow(simplex_noise(1, xf * 5, yf * 5, zf * 5), 3);
-    if (caves < 0.5) {
-      density = 0;
-    } else {
-      center_falloff =
-          0.1 / (pow((xf - 0.5) * 1.5, 2) + pow((yf - 1.0) * 0.8, 2) +
-                 pow((zf - 0.5) * 1.5, 2));
-      density = (simplex_noise(5, xf, yf * 0.5, zf) * center_falloff *
-                 plateau_falloff);
-      density *=
-          pow(noise((xf + 1) * 3.0, (yf + 1) * 3.0, (zf + 1) * 3.0) + 0.4, 1.8);
+  // With a coarser lattice the fields are sampled every s voxels, at world
+  // positions so that neighboring chunks share their border samples, and
+  // interpolated trilinearly in between. Each field is smooth, the cave test
+  // and the density are still evaluated per voxel.
+  const std::size_t nx = chunk::width / s + 1, ny = chunk::height / s + 1,
+                    nz = chunk::depth / s + 1;
+  static thread_local std::array<std::vector<float>, 3> lattice;
+  if (s > 1) {
+    column lattice_yf;
+    for (std::size_t j = 0; j < ny; ++j) {
+      lattice_yf[j] = (world_y + j * s) / ((float)world_height * chunk_height);
+    }
+    for (auto &field : lattice) {
+      field.resize(nx * ny * nz);
+    }
+    for (std::size_t k = 0; k < nz; ++k) {
+      for (std::size_t i = 0; i < nx; ++i) {
+        const auto first = (i + nx * k) * ny;
+        sample(to_xf(world_x + i * s), lattice_yf.data(),
+               to_zf(world_z + k * s), ny, &lattice[0][first],
+               &lattice[1][first], &lattice[2][first]);
+      }
     }
+  }
+
+  for (local_size_t z = 0; z < chunk::depth; ++z) {
+    for (local_size_t x = 0; x < chunk::width; ++x) {
+      const float xf = to_xf(world_x + x), zf = to_zf(world_z + z);
+      const double falloff_x = pow((xf - 0.5) * 1.5, 2),
+                  falloff_z = pow((zf - 0.5) * 1.5, 2);
+
+      std::size_t rock_count = 0;
+      if (s > 1) {
+        // Bilinear along x and z gives a column of ny samples, then linear
+        // along y
+        const auto i = x / s, k = z / s;
+        const float fx = float(x % s) / s, fz = float(z % s) / s;
+        const float w00 = (1 - fx) * (1 - fz), w10 = fx * (1 - fz),
+                    w01 = (1 - fx) * fz, w11 = fx * fz;
+        const auto c00 = (i + nx * k) * ny, c10 = c00 + ny,
+                   c01 = c00 + nx * ny, c11 = c01 + ny;
+        std::array<column, 3> samples;
+        for (std::size_t f = 0; f < lattice.size(); ++f) {
+          const auto &field = lattice[f];
+          for (std::size_t j = 0; j < ny; ++j) {
+            samples[f][j] = w00 * field[c00 + j] + w10 * field[c10 + j] +
+                            w01 * field[c01 + j] + w11 * field[c11 + j];
+          }
+        }
+        const auto at = [&samples, s](const std::size_t f,
+                                      const local_size_t y) {
+          const auto j = y / s;
+          const float fy = float(y % s) / s;
+          return samples[f][j] + (samples[f][j + 1] - samples[f][j]) * fy;
+        };
+        for (local_size_t y = 0; y < chunk::height; ++y) {
+          const float cave = at(0, y);
+          if (!(cave * cave * cave < 0.5f)) {
+            octaves[rock_count] = at(1, y);
+            detail[rock_count] = at(2, y);
+            rock[rock_count++] = y;
+          }
+        }
+      } else {
+        for (local_size_t y = 0; y < chunk::height; ++y) {
+          px[y] = xf * 5 + offset[0];
+          py[y] = yf[y] * 5 + offset[1];
+          pz[y] = zf * 5 + offset[2];
+        }
+        noise::simplex_batch(px.data(), py.data(), pz.data(), caves.data(),
+                             chunk::height);
+        for (local_size_t y = 0; y < chunk::height; ++y) {
+          const float cave = pow(caves[y], 3);
+          if (!(cave < 0.5)) {
+            rock[rock_count++] = y;
+          }
+        }
+        for (std::size_t i = 0; i < rock_count; ++i) {
+          px[i] = xf + offset[0];
+          py[i] = yf[rock[i]] * 0.5 + offset[1];
+          pz[i] = zf + offset[2];
+        }
+        noise::simplex_octaves_batch(5, px.data(), py.data(), pz.data(),
+                                     octaves.data(), rock_count);
+        for (std::size_t i = 0; i < rock_count; ++i) {
+          px[i] = (xf + 1) * 3.0 + offset[0];
+          py[i] = (yf[rock[i]] + 1) * 3.0 + offset[1];
+          pz[i] = (zf + 1) * 3.0 + offset[2];
+        }
+        noise::simplex_batch(px.data(), py.data(), pz.data(), detail.data(),
+                             rock_count);
+      }
 
-    block_type t;
-    if (density < 3.1) {
-      t = block_type::air;
-    } else if (yf > grass_dist(e)) {
-      t = block_type::grass;
-    } else if (yf > dirt_dist(e)) {
-      t = block_type::dirt;
-    } else {
-      t = block_type::stone;
+      density.fill(0);
+      for (std::size_t i = 0; i < rock_count; ++i) {
+        const auto y = rock[i];
+        const float center_falloff =
+            0.1 / (falloff_x + falloff_y[y] + falloff_z);
+        density[y] = (octaves[i] * center_falloff * plateau[y]);
+        density[y] *= pow(detail[i] + 0.4, 1.8);
+      }
+
+      std::array<block_type, chunk::height> types;
+      for (local_size_t y = 0; y < chunk::height; ++y) {
+        auto &t = types[y];
+        if (density[y] < 3.1) {
+          t = block_type::air;
+          continue;
+        }
+        // grass above a height drawn from [0.8, 0.9), dirt above one drawn
+        // from [0.4, 0.7), both per voxel
+        const auto bits = noise::hash(seed, world_x + x, world_y + y,
+                                      world_z + z);
+        const float grass_line = 0.8f + 0.1f * noise::to_unit(bits);
+        const float dirt_line = 0.4f + 0.3f * noise::to_unit(bits >> 32);
+        if (yf[y] > grass_line) {
+          t = block_type::grass;
+        } else if (yf[y] > dirt_line) {
+          t = block_type::dirt;
+        } else {
+          t = block_type::stone;
+        }
+      }
+      c.set_column(x, 0, z, chunk::height, types.data());
     }
-    c.set(x, y, z, t);
   }
-  ;
-  auto shared_chunk = std::make_shared<chunk>();
-  for_each_voxel(*shared_chunk, build_rock);
+  shared_chunk->shrink_to_fit();
   return {key, shared_chunk};
 }
 
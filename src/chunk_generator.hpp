@@ -1,15 +1,40 @@
 #pragma once
 #include "chunk.hpp"
 #include "types.hpp"
+#include <cstdint>
 #include <tuple>
 
 namespace lexov {
 
+// Generators are pure functions of their arguments: the same seed always
+// produces the same chunks, see noise::hash
+using world_seed = std::uint64_t;
+constexpr const world_seed default_world_seed = 0;
+// make_floating_rock samples its noise at every voxel, larger spacings sample
+// a lattice every that many voxels and interpolate in between
+constexpr const local_size_t exact_density = 1;
+// What chunks are streamed with unless the settings say otherwise
+constexpr const local_size_t default_density_lattice = 4;
+// Spacings must divide the chunk's dimensions
+constexpr bool is_lattice_spacing(const local_size_t s) {
+  return s > 0 && chunk_width % s == 0 && chunk_height % s == 0 &&
+         chunk_depth % s == 0;
+}
+
 namespace chunk_generator {
-  chunk_ptr make_solid_chunk(const block_type type);
-  chunk_ptr make_random_chunk(const double p);
-  chunk_ptr make_pyramid();
-  std::tuple<chunk_key, chunk_ptr> make_floating_rock(const chunk_key);
+  chunk_ptr make_solid_chunk(const block_type type,
+                             const chunk_storage storage = chunk_storage::array);
+  // Voxels are air with probability p, keyed on their world coordinates
+  chunk_ptr make_random_chunk(const chunk_key key, const double p,
+                              const chunk_storage storage = chunk_storage::array,
+                              const world_seed seed = default_world_seed);
+  chunk_ptr make_pyramid(const chunk_storage storage = chunk_storage::array,
+                         const world_seed seed = default_world_seed);
+  std::tuple<chunk_key, chunk_ptr>
+  make_floating_rock(const chunk_key,
+                     const chunk_storage storage = chunk_storage::array,
+                     const world_seed seed = default_world_seed,
+                     const local_size_t lattice_spacing = exact_density);
 }
 
 } // namespace lexov
@@ -0,0 +1,446 @@
+#include "chunk_io.hpp"
+#include "utility.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+using lexov::chunk;
+using byte = std::uint8_t;
+
+const byte region_magic[] = { 'L', 'X', 'R', 'G' };
+constexpr std::uint32_t region_version = 2;
+constexpr std::size_t header_size = 24;
+constexpr std::size_t entry_size = 8;
+constexpr std::size_t record_header_size = 8;
+
+enum class encoding : byte {
+  raw, runs
+};
+
+void put_u16(std::vector<byte> &out, const std::uint16_t v) {
+  out.push_back(v & 0xff);
+  out.push_back(v >> 8);
+}
+
+void put_u32(byte *out, const std::uint32_t v) {
+  out[0] = v & 0xff;
+  out[1] = (v >> 8) & 0xff;
+  out[2] = (v >> 16) & 0xff;
+  out[3] = v >> 24;
+}
+
+std::uint16_t get_u16(const byte *in) { return in[0] | in[1] << 8; }
+
+std::uint32_t get_u32(const byte *in) {
+  return in[0] | in[1] << 8 | in[2] << 16 |
+         static_cast<std::uint32_t>(in[3]) << 24;
+}
+
+std::size_t sectors_for(const std::size_t bytes) {
+  return (bytes + lexov::region_sector_size - 1) / lexov::region_sector_size;
+}
+
+// The header and offset table fill the first sectors
+const std::size_t first_data_sector =
+    sectors_for(header_size + lexov::region_size * lexov::region_size *
+                                  entry_size);
+
+// pwrite until everything is written
+void write_all(const int fd, const byte *data, std::size_t size,
+               std::size_t offset) {
+  while (size > 0) {
+    const auto written = ::pwrite(fd, data, size, offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error{ std::string{ "Failed to write region: " } +
+                                std::strerror(errno) };
+    }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+}
+
+// Chunk coordinate inside its region
+lexov::world_size_t local_coordinate(const lexov::world_size_t v) {
+  return v - lexov::floor_div(v, lexov::region_size) * lexov::region_size;
+}
+
+std::size_t table_index(const lexov::world_size_t x,
+                        const lexov::world_size_t z) {
+  return static_cast<std::size_t>(x + lexov::region_size * z);
+}
+}
+
+namespace lexov {
+
+auto chunk_io::encode_chunk(const chunk &c) -> chunk_record {
+  chunk_record record(record_header_size, 0);
+  std::array<block_type, chunk::width> row;
+  block_type run_type = block_type::air;
+  std::size_t run = 0;
+  for (local_size_t z = 0; z < chunk::depth; ++z) {
+    for (local_size_t y = 0; y < chunk::height; ++y) {
+      c.get_row(y, z, row.data());
+      for (const auto t : row) {
+        if (run > 0 && (t != run_type || run == 0xffff)) {
+          record.push_back(static_cast<byte>(run_type));
+          put_u16(record, run);
+          run = 0;
+        }
+        run_type = t;
+        ++run;
+      }
+    }
+  }
+  record.push_back(static_cast<byte>(run_type));
+  put_u16(record, run);
+
+  // noisy chunks are smaller as plain bytes
+  auto e = encoding::runs;
+  if (record.size() > record_header_size + chunk::volume) {
+    e = encoding::raw;
+    record.resize(record_header_size);
+    for (local_size_t z = 0; z < chunk::depth; ++z) {
+      for (local_size_t y = 0; y < chunk::height; ++y) {
+        c.get_row(y, z, row.data());
+        for (const auto t : row) {
+          record.push_back(static_cast<byte>(t));
+        }
+      }
+    }
+  }
+  record[0] = static_cast<byte>(e);
+  put_u32(&record[4], chunk::volume);
+  return record;
+}
+
+chunk_ptr chunk_io::decode_chunk(const std::uint8_t *record,
+                                 const std::size_t size,
+                                 const chunk_storage storage) {
+  if (size < record_header_size || get_u32(record + 4) != chunk::volume) {
+    return nullptr;
+  }
+  const auto e = static_cast<encoding>(record[0]);
+  const auto payload = record + record_header_size;
+  const auto payload_size = size - record_header_size;
+  const auto valid = [](const byte t) {
+    return t < static_cast<byte>(block_type::count);
+  };
+  // Decoded into a dense buffer in chunk order, then written in one go
+  static thread_local std::vector<block_type> voxels;
+  voxels.assign(chunk::volume, block_type::air);
+  std::size_t i = 0;
+  const auto put = [&i](const block_type t) { voxels[i++] = t; };
+  if (e == encoding::raw) {
+    if (payload_size != chunk::volume) {
+      return nullptr;
+    }
+    for (std::size_t p = 0; p < payload_size; ++p) {
+      if (!valid(payload[p])) {
+        return nullptr;
+      }
+      put(static_cast<block_type>(payload[p]));
+    }
+  } else if (e == encoding::runs) {
+    if (payload_size % 3 != 0) {
+      return nullptr;
+    }
+    for (std::size_t p = 0; p < payload_size; p += 3) {
+      const auto length = get_u16(payload + p + 1);
+      if (!valid(payload[p]) || i + length > chunk::volume) {
+        return nullptr;
+      }
+      const auto t = static_cast<block_type>(payload[p]);
+      std::fill(voxels.begin() + i, voxels.begin() + i + length, t);
+      i += length;
+    }
+  } else {
+    return nullptr;
+  }
+  if (i != chunk::volume) {
+    return nullptr;
+  }
+  auto c = make_chunk(storage);
+  c->set_voxels(voxels.data());
+  c->shrink_to_fit();
+  return c;
+}
+
+region_file::region_file(const std::string &path, const world_seed seed,
+                         const local_size_t lattice_spacing) {
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    throw std::runtime_error{ "Failed to open region " + path + ": " +
+                              std::strerror(errno) };
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error{ "Failed to stat region " + path };
+  }
+  table.fill(table_entry{ 0, 0 });
+  if (st.st_size == 0) {
+    // new region: header, empty table, sector aligned
+    std::vector<byte> header(first_data_sector * region_sector_size, 0);
+    std::copy(std::begin(region_magic), std::end(region_magic),
+              header.begin());
+    put_u32(&header[4], region_version);
+    put_u32(&header[8], seed & 0xffffffff);
+    put_u32(&header[12], seed >> 32);
+    put_u32(&header[16], lattice_spacing);
+    try {
+      write_all(fd, header.data(), header.size(), 0);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    file_sectors = first_data_sector;
+    used_sectors.assign(file_sectors, true);
+    return;
+  }
+  file_sectors = sectors_for(st.st_size);
+  if (file_sectors < first_data_sector ||
+      !map(first_data_sector * region_sector_size) ||
+      !std::equal(std::begin(region_magic), std::end(region_magic), mapping) ||
+      get_u32(mapping + 4) != region_version) {
+    unmap();
+    ::close(fd);
+    throw std::runtime_error{ path + " is not a region file" };
+  }
+  const auto file_seed = get_u32(mapping + 8) |
+                         static_cast<world_seed>(get_u32(mapping + 12)) << 32;
+  if (file_seed != seed) {
+    unmap();
+    ::close(fd);
+    throw std::runtime_error{ path + " holds the chunks of world seed " +
+                              std::to_string(file_seed) };
+  }
+  const auto file_lattice = get_u32(mapping + 16);
+  if (file_lattice != lattice_spacing) {
+    unmap();
+    ::close(fd);
+    throw std::runtime_error{ path + " holds chunks of density lattice " +
+                              std::to_string(file_lattice) };
+  }
+  used_sectors.assign(file_sectors, false);
+  mark_sectors(0, first_data_sector, true);
+  for (std::size_t i = 0; i < table_entries; ++i) {
+    const auto entry = mapping + header_size + i * entry_size;
+    table[i] = table_entry{ get_u32(entry), get_u32(entry + 4) };
+    if (table[i].sector != 0) {
+      mark_sectors(table[i].sector, sectors_for(table[i].size), true);
+    }
+  }
+}
+
+region_file::~region_file() {
+  unmap();
+  ::close(fd);
+}
+
+bool region_file::map(const std::size_t bytes) {
+  if (mapping && mapped_size >= bytes) {
+    return true;
+  }
+  unmap();
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < bytes) {
+    return false;
+  }
+  const auto m = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED) {
+    return false;
+  }
+  mapping = static_cast<const std::uint8_t *>(m);
+  mapped_size = st.st_size;
+  return true;
+}
+
+void region_file::mark_sectors(const std::size_t first,
+                               const std::size_t count, const bool used) {
+  if (first + count > used_sectors.size()) {
+    used_sectors.resize(first + count, false);
+  }
+  std::fill(used_sectors.begin() + first, used_sectors.begin() + first + count,
+            used);
+}
+
+std::size_t region_file::find_free_sectors(const std::size_t count) const {
+  std::size_t run = 0;
+  for (std::size_t s = first_data_sector; s < file_sectors; ++s) {
+    run = used_sectors[s] ? 0 : run + 1;
+    if (run == count) {
+      return s + 1 - count;
+    }
+  }
+  // a free run at the end only needs the file to grow by the rest
+  return file_sectors - run;
+}
+
+void region_file::unmap() {
+  if (mapping) {
+    ::munmap(const_cast<std::uint8_t *>(mapping), mapped_size);
+    mapping = nullptr;
+    mapped_size = 0;
+  }
+}
+
+bool region_file::has_chunk(const world_size_t x, const world_size_t z) const {
+  std::lock_guard<std::mutex> lock{ mutex };
+  return table[table_index(x, z)].sector != 0;
+}
+
+chunk_ptr region_file::read_chunk(const world_size_t x, const world_size_t z,
+                                  const chunk_storage storage) {
+  std::lock_guard<std::mutex> lock{ mutex };
+  const auto entry = table[table_index(x, z)];
+  if (entry.sector == 0) {
+    return nullptr;
+  }
+  const std::size_t begin = entry.sector * region_sector_size;
+  // the file grows with every appended record, remap when needed
+  if (!map(begin + entry.size)) {
+    return nullptr;
+  }
+  return chunk_io::decode_chunk(mapping + begin, entry.size, storage);
+}
+
+void region_file::write_chunk(const world_size_t x, const world_size_t z,
+                              const chunk_io::chunk_record &record) {
+  std::lock_guard<std::mutex> lock{ mutex };
+  const auto index = table_index(x, z);
+  auto entry = table[index];
+  const auto sectors = sectors_for(record.size());
+  if (entry.sector != 0 && sectors_for(entry.size) >= sectors) {
+    // in place, the sectors the record no longer needs become free
+    mark_sectors(entry.sector + sectors, sectors_for(entry.size) - sectors,
+                 false);
+  } else {
+    if (entry.sector != 0) {
+      mark_sectors(entry.sector, sectors_for(entry.size), false);
+    }
+    entry.sector = static_cast<std::uint32_t>(find_free_sectors(sectors));
+    file_sectors = std::max(file_sectors, entry.sector + sectors);
+    mark_sectors(entry.sector, sectors, true);
+  }
+  entry.size = static_cast<std::uint32_t>(record.size());
+  // pad the record so the file stays a whole number of sectors
+  std::vector<byte> padded(sectors * region_sector_size, 0);
+  std::copy(record.begin(), record.end(), padded.begin());
+  write_all(fd, padded.data(), padded.size(),
+            entry.sector * region_sector_size);
+  byte encoded_entry[entry_size];
+  put_u32(encoded_entry, entry.sector);
+  put_u32(encoded_entry + 4, entry.size);
+  write_all(fd, encoded_entry, entry_size, header_size + index * entry_size);
+  table[index] = entry;
+}
+
+std::size_t region_file::size() const {
+  std::lock_guard<std::mutex> lock{ mutex };
+  return file_sectors * region_sector_size;
+}
+
+region_store::region_store(const std::string &directory,
+                           const world_seed seed,
+                           const local_size_t lattice_spacing)
+    : directory{ directory }, seed{ seed },
+      lattice_spacing{ lattice_spacing } {
+  if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    throw std::runtime_error{ "Failed to create " + directory + ": " +
+                              std::strerror(errno) };
+  }
+}
+
+std::shared_ptr<region_file> region_store::get_region(const chunk_key &key,
+                                                     const bool create) {
+  const chunk_key region{ floor_div(std::get<0>(key), region_size),
+                          std::get<1>(key),
+                          floor_div(std::get<2>(key), region_size) };
+  std::lock_guard<std::mutex> lock{ mutex };
+  const auto itr = regions.find(region);
+  if (itr != regions.end()) {
+    return itr->second;
+  }
+  const auto path = directory + "/r." + std::to_string(std::get<0>(region)) +
+                    "." + std::to_string(std::get<1>(region)) + "." +
+                    std::to_string(std::get<2>(region)) + ".lxr";
+  struct stat st;
+  if (!create && ::stat(path.c_str(), &st) != 0) {
+    return nullptr;
+  }
+  // only cache the region once it opened, a failed open is retried later
+  const auto file = std::make_shared<region_file>(path, seed, lattice_spacing);
+  regions[region] = file;
+  return file;
+}
+
+chunk_ptr region_store::load(const chunk_key &key,
+                             const chunk_storage storage) {
+  const auto region = get_region(key, false);
+  if (!region) {
+    return nullptr;
+  }
+  return region->read_chunk(local_coordinate(std::get<0>(key)),
+                            local_coordinate(std::get<2>(key)), storage);
+}
+
+void region_store::save(const chunk_key &key,
+                        const chunk_io::chunk_record &record) {
+  const auto region = get_region(key, true);
+  if (!region) {
+    throw std::runtime_error{ "No region to save chunk in" };
+  }
+  region->write_chunk(local_coordinate(std::get<0>(key)),
+                      local_coordinate(std::get<2>(key)), record);
+}
+
+void region_store::close_distant_regions(const chunk_key &center,
+                                         const world_size_t radius,
+                                         const world_size_t vertical_radius) {
+  std::lock_guard<std::mutex> lock{ mutex };
+  for (auto itr = regions.begin(); itr != regions.end();) {
+    // distance to the nearest chunk column of the region
+    const auto nearest = [](const world_size_t c, const world_size_t region) {
+      const auto first = region * region_size;
+      return c - std::min(std::max(c, first), first + region_size - 1);
+    };
+    const auto dx = nearest(std::get<0>(center), std::get<0>(itr->first));
+    const auto dy = std::get<1>(itr->first) - std::get<1>(center);
+    const auto dz = nearest(std::get<2>(center), std::get<2>(itr->first));
+    // nobody else can take a reference while the mutex is held
+    if ((dx * dx + dz * dz > radius * radius ||
+         std::abs(dy) > vertical_radius) &&
+        itr->second.use_count() == 1) {
+      itr = regions.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
+std::size_t region_store::number_of_regions() const {
+  std::lock_guard<std::mutex> lock{ mutex };
+  return regions.size();
+}
+
+std::size_t region_store::disk_usage() const {
+  std::lock_guard<std::mutex> lock{ mutex };
+  std::size_t bytes = 0;
+  for (const auto &itr : regions) {
+    bytes += itr.second->size();
+  }
+  return bytes;
+}
+
+} // namespace lexov
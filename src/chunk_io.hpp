@@ -0,0 +1,138 @@
+#pragma once
+#include "chunk.hpp"
+#include "chunk_generator.hpp"
+#include "flat_chunk_map.hpp"
+#include "types.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lexov {
+
+// Region files store the chunks of region_size x region_size chunk columns of
+// one chunk layer, i.e. the region of chunk (x, y, z) is
+// (floor(x / 32), y, floor(z / 32)).
+//
+// Layout, all integers little endian:
+//   header     "LXRG", u32 version, u64 world seed, u32 density lattice
+//              spacing, 4 reserved bytes
+//   table      region_size^2 entries of u32 first sector, u32 record bytes;
+//              a first sector of 0 marks a missing chunk
+//   records    start on region_sector_size boundaries:
+//              u8 encoding, 3 reserved bytes, u32 voxel count, payload
+//
+// The raw encoding stores one byte per voxel, the run encoding (u8 type,
+// u16 length) pairs; both in the x, y, z order of chunk::get_row.
+constexpr const world_size_t region_size = 32;
+constexpr const std::size_t region_sector_size = 4096;
+
+namespace chunk_io {
+  // Serialized chunk record, ready to be written to a region file. Encoding
+  // is pure and runs on any thread.
+  using chunk_record = std::vector<std::uint8_t>;
+  chunk_record encode_chunk(const chunk &c);
+  // Returns nullptr for a malformed record
+  chunk_ptr decode_chunk(const std::uint8_t *record, const std::size_t size,
+                         const chunk_storage storage);
+}
+
+// One region file. The file is memory mapped read only and chunks are decoded
+// straight from the mapping; writes go through the file descriptor. All
+// methods are thread safe.
+class region_file {
+public:
+  // Opens path, creating an empty region of the seed and lattice spacing
+  // when it doesn't exist. Throws std::runtime_error when the file can't be
+  // opened, isn't a region file or holds the chunks of another seed or
+  // lattice spacing.
+  region_file(const std::string &path, const world_seed seed,
+              const local_size_t lattice_spacing);
+  ~region_file();
+  region_file(const region_file &) = delete;
+  region_file &operator=(const region_file &) = delete;
+
+  // Local chunk coordinates are in [0, region_size)
+  bool has_chunk(const world_size_t x, const world_size_t z) const;
+  chunk_ptr read_chunk(const world_size_t x, const world_size_t z,
+                       const chunk_storage storage);
+  // Rewrites the record in place when it still fits its sectors, otherwise
+  // moves it to the first run of free sectors that fits, or to the end of
+  // the file
+  void write_chunk(const world_size_t x, const world_size_t z,
+                   const chunk_io::chunk_record &record);
+  // Size of the file in bytes
+  std::size_t size() const;
+
+private:
+  struct table_entry {
+    std::uint32_t sector;
+    std::uint32_t size;
+  };
+  static constexpr std::size_t table_entries = region_size * region_size;
+
+  // Maps at least the first bytes of the file, mutex must be held
+  bool map(const std::size_t bytes);
+  void unmap();
+  // Marks count sectors from first as used or free, mutex must be held
+  void mark_sectors(const std::size_t first, const std::size_t count,
+                    const bool used);
+  // First sector of a free run of count sectors, which may extend past the
+  // end of the file; mutex must be held
+  std::size_t find_free_sectors(const std::size_t count) const;
+
+  mutable std::mutex mutex;
+  int fd{ -1 };
+  const std::uint8_t *mapping{ nullptr };
+  std::size_t mapped_size{ 0 };
+  std::size_t file_sectors{ 0 };
+  std::array<table_entry, table_entries> table;
+  // Sectors held by the header, the table or a record, built from the table
+  // when the file is opened
+  std::vector<bool> used_sectors;
+};
+
+// Directory of region files of one world seed and density lattice spacing,
+// opened on demand. Chunks sampled on another lattice would show seams at
+// the borders to the stored ones.
+class region_store {
+public:
+  // Creates directory when it doesn't exist
+  explicit region_store(
+      const std::string &directory, const world_seed seed = default_world_seed,
+      const local_size_t lattice_spacing = default_density_lattice);
+
+  // Returns nullptr when the chunk was never saved
+  chunk_ptr load(const chunk_key &key, const chunk_storage storage);
+  void save(const chunk_key &key, const chunk_io::chunk_record &record);
+
+  // Closes the regions without a chunk column within radius of center, or
+  // further than vertical_radius layers from it, unless a load or save is
+  // still using them
+  void close_distant_regions(const chunk_key &center,
+                             const world_size_t radius,
+                             const world_size_t vertical_radius);
+
+  world_seed get_seed() const { return seed; }
+  local_size_t get_lattice_spacing() const { return lattice_spacing; }
+  // Open regions
+  std::size_t number_of_regions() const;
+  // Bytes of all open region files
+  std::size_t disk_usage() const;
+
+private:
+  // Returns nullptr when the region doesn't exist and create is false
+  std::shared_ptr<region_file> get_region(const chunk_key &key,
+                                          const bool create);
+
+  std::string directory;
+  world_seed seed;
+  local_size_t lattice_spacing;
+  mutable std::mutex mutex;
+  // Shared with the loads and saves in flight, which may outlive eviction
+  flat_chunk_map<std::shared_ptr<region_file>> regions;
+};
+
+} // namespace lexov
@@ -1,29 +1,118 @@
 #include "chunk_manager.hpp"
 #include "chunk_generator.hpp"
-#include "chunk_renderer.hpp"
+#include "chunk_io.hpp"
+#include "chunk_mesher.hpp"
+#include "frame_timing.hpp"
+#include "job_system.hpp"
+#include "mesh_sink.hpp"
 #include <cassert>
-#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
 #include <future>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
-namespace lexov {
-chunk_manager::chunk_manager(chunk_renderer &cr) : renderer{ cr } {
-  std::vector<std::future<std::tuple<chunk_key, chunk_ptr>>> chunk_futures;
-  chunk_futures.reserve(world_depth * world_height * world_depth);
-  for (world_size_t z = 0; z < world_depth; ++z) {
-    for (world_size_t y = 0; y < world_height; ++y) {
-      for (world_size_t x = 0; x < world_width; ++x) {
-        const auto k = chunk_key{x, y, z};
-        chunk_futures.push_back(std::async(std::launch::async, chunk_generator::make_floating_rock, k));
+namespace {
+// The border voxels of the neighbor lose their cover once c is unloaded;
+// facing is the neighbor's face that touches c
+template <lexov::face side, lexov::face facing>
+void mark_neighbor_dirty(const lexov::chunk &c) {
+  if (const auto neighbor = c.get_neighbor<side>()) {
+    neighbor->mark_dirty(lexov::chunk::border_sections(facing));
+  }
+}
+
+// Throws std::runtime_error for settings the manager can't stream with
+const lexov::streaming_settings &
+checked(const lexov::streaming_settings &settings) {
+  if (!lexov::is_lattice_spacing(settings.density_lattice)) {
+    throw std::runtime_error{
+      "Density lattice spacing " + std::to_string(settings.density_lattice) +
+      " doesn't divide the chunk size"
+    };
+  }
+  return settings;
+}
+
+// Runs on a worker. Captures nothing of the chunk_manager, which may be gone
+// by the time the job runs.
+std::tuple<lexov::chunk_key, lexov::chunk_ptr>
+load_or_generate(lexov::job_system &jobs, lexov::region_store *store,
+                 const lexov::chunk_key &key, const lexov::chunk_storage s,
+                 const lexov::world_seed seed,
+                 const lexov::local_size_t lattice_spacing) {
+  using namespace lexov;
+  LEXOV_TIME_PHASE(frame_phase::generation);
+  if (store) {
+    try {
+      if (auto c = store->load(key, s)) {
+        return std::make_tuple(key, c);
       }
     }
+    catch (std::runtime_error &e) {
+      // an unreadable region must not take the game down, generate instead
+      std::cerr << e.what() << std::endl;
+    }
   }
-  for (auto &f : chunk_futures) {
-    auto res = f.get();
-    insert_chunk(std::get<0>(res), std::get<1>(res));
+  auto res = chunk_generator::make_floating_rock(key, s, seed, lattice_spacing);
+  if (store) {
+    // encode now while no other thread sees the chunk, an idle worker does
+    // the write
+    const auto record = std::make_shared<chunk_io::chunk_record>(
+        chunk_io::encode_chunk(*std::get<1>(res)));
+    jobs.submit_detached([store, key, record]() {
+      try {
+        store->save(key, *record);
+      }
+      catch (std::runtime_error &e) {
+        // the chunk is generated again next time
+        std::cerr << e.what() << std::endl;
+      }
+    }, job_priority::low);
+  }
+  return res;
+}
+}
+
+namespace lexov {
+chunk_manager::chunk_manager(mesh_sink &sink, job_system &jobs,
+                             const chunk_storage storage,
+                             const streaming_settings settings)
+    : sink{ sink }, jobs{ jobs }, storage{ storage },
+      settings{ checked(settings) } {}
+
+void chunk_manager::set_streaming_settings(const streaming_settings s) {
+  // chunks of another lattice would not match the stored ones at the borders
+  if (regions && s.density_lattice != regions->get_lattice_spacing()) {
+    throw std::runtime_error{
+      "The region store holds chunks of another density lattice"
+    };
+  }
+  settings = checked(s);
+}
+
+void chunk_manager::set_region_store(region_store *store) {
+  regions = store;
+  if (regions) {
+    seed = regions->get_seed();
+    settings.density_lattice = regions->get_lattice_spacing();
   }
 }
 
+void chunk_manager::set_world_seed(const world_seed s) {
+  // the chunks would be saved into files of the store's seed
+  if (regions && s != regions->get_seed()) {
+    throw std::runtime_error{ "The region store holds another world seed" };
+  }
+  seed = s;
+}
+
 void chunk_manager::insert_chunk(const chunk_key &key, chunk_ptr ptr) {
   // set up chunk neighbors
   const auto x = std::get<0>(key);
@@ -72,48 +161,235 @@ void chunk_manager::insert_chunk(const chunk_key &key, chunk_ptr ptr) {
     neighbor->set_neighbor<face::top>(ptr);
     ptr->set_neighbor<face::bottom>(neighbor);
   }
-  renderer.on_chunk_insertion(key, *ptr);
+  // a chunk the sink can't take yet stays dirty and is offered again by
+  // update
+  const auto level = select_lod(center, key, 0);
+  if (sink.on_chunk_insertion(key, *ptr, level)) {
+    ptr->mark_clean();
+  }
   all_chunks[key] = ptr;
+  lod_levels[key] = level;
   assert(all_chunks.find(key) != all_chunks.end());
 }
 
 void chunk_manager::remove_chunk(const chunk_key &key) {
-  if (auto itr = all_chunks.find(key) != all_chunks.end()) {
-    renderer.on_chunk_removal(key);
+  const auto itr = all_chunks.find(key);
+  if (itr != all_chunks.end()) {
+    const auto &c = *itr->second;
+    mark_neighbor_dirty<face::front, face::back>(c);
+    mark_neighbor_dirty<face::back, face::front>(c);
+    mark_neighbor_dirty<face::left, face::right>(c);
+    mark_neighbor_dirty<face::right, face::left>(c);
+    mark_neighbor_dirty<face::top, face::bottom>(c);
+    mark_neighbor_dirty<face::bottom, face::top>(c);
+    sink.on_chunk_removal(key);
     all_chunks.erase(itr);
+    lod_levels.erase(key);
+  }
+}
+
+bool chunk_manager::is_in_range(const chunk_key &center, const chunk_key &key,
+                                const world_size_t radius) const {
+  const auto dx = std::get<0>(key) - std::get<0>(center);
+  const auto dy = std::get<1>(key) - std::get<1>(center);
+  const auto dz = std::get<2>(key) - std::get<2>(center);
+  return dx * dx + dz * dz <= radius * radius &&
+         std::abs(dy) <= settings.vertical_radius;
+}
+
+unsigned chunk_manager::select_lod(const chunk_key &center,
+                                  const chunk_key &key,
+                                  const unsigned current) const {
+  const auto dx = std::get<0>(key) - std::get<0>(center);
+  const auto dz = std::get<2>(key) - std::get<2>(center);
+  const auto distance = dx * dx + dz * dz;
+  // Coarsest level the chunk is surely far enough for, and the finest one
+  // it is surely close enough for
+  unsigned coarse = 0, fine = 0;
+  for (const auto r : settings.lod_radius) {
+    const auto outer = r + settings.lod_hysteresis;
+    const auto inner = std::max<world_size_t>(r - settings.lod_hysteresis, 0);
+    coarse += distance > outer * outer;
+    fine += distance > inner * inner;
+  }
+  return std::min(std::max(current, coarse), fine);
+}
+
+void chunk_manager::update_meshes(const chunk_key &center) {
+  for (const auto &itr : all_chunks) {
+    auto &c = *itr.second;
+    auto &level = lod_levels[itr.first];
+    const auto wanted = select_lod(center, itr.first, level);
+    if (wanted != level) {
+      // the whole chunk at the new level, which also covers dirty sections
+      if (sink.on_chunk_update(itr.first, c, chunk::all_sections,
+                                   wanted)) {
+        level = static_cast<std::uint8_t>(wanted);
+        c.mark_clean();
+      }
+      continue;
+    }
+    const auto sections = c.get_dirty_sections();
+    if (sections != 0 &&
+        sink.on_chunk_update(itr.first, c, sections, level)) {
+      c.mark_clean(sections);
+    }
+  }
+}
+
+void chunk_manager::collect_generated_chunks(const chunk_key &center) {
+  for (auto itr = pending_chunks.begin(); itr != pending_chunks.end();) {
+    auto &pending = itr->second;
+    // the camera may have moved away while the chunk was queued
+    if (!is_in_range(center, itr->first, settings.unload_radius)) {
+      *pending.cancelled = true;
+      itr = pending_chunks.erase(itr);
+      continue;
+    }
+    if (pending.result.wait_for(std::chrono::seconds{ 0 }) !=
+        std::future_status::ready) {
+      ++itr;
+      continue;
+    }
+    auto res = pending.result.get();
+    insert_chunk(std::get<0>(res), std::get<1>(res));
+    itr = pending_chunks.erase(itr);
   }
 }
 
-void chunk_manager::update(const world_size_t , const world_size_t , const world_size_t ) {
-  // Determine chunks that need building based on camera position + lookat
-  //  - vector / queue / priority queue of chunk keys
-  // add work to the build -> mesh -> insert pipeline
-  //  - build chunk, store result in manager (concurrent datastructure for storage)
-  //  - mesh chunk, store result in renderer (concurrent datastructure for storage)
-  // Determine chunks that need removal
-  //  - remove chunks from manager
-  //  - remove chunks from renderer
+void chunk_manager::unload_distant_chunks(const chunk_key &center) {
+  std::vector<chunk_key> distant;
   for (const auto &itr : all_chunks) {
-    if (itr.second->is_dirty()) {
-      renderer.on_chunk_update(itr.first, *itr.second);
-      itr.second->mark_clean();
+    if (!is_in_range(center, itr.first, settings.unload_radius)) {
+      distant.push_back(itr.first);
+    }
+  }
+  for (const auto &key : distant) {
+    remove_chunk(key);
+  }
+  // keeps the open files and mappings bounded on long flights
+  if (regions) {
+    regions->close_distant_regions(center, settings.unload_radius,
+                                   settings.vertical_radius);
+  }
+}
+
+void chunk_manager::request_chunks(const chunk_key &center,
+                                   const std::array<float, 3> &eye,
+                                   const std::array<float, 3> &view_direction) {
+  if (pending_chunks.size() >= settings.max_pending) {
+    return;
+  }
+  // Candidates are ranked by their distance to the camera, which is doubled
+  // for chunks straight behind it
+  using candidate = std::pair<float, chunk_key>;
+  std::priority_queue<candidate, std::vector<candidate>,
+                      std::greater<candidate>> candidates;
+  const auto r = settings.load_radius;
+  const auto vr = settings.vertical_radius;
+  for (world_size_t dz = -r; dz <= r; ++dz) {
+    for (world_size_t dx = -r; dx <= r; ++dx) {
+      if (dx * dx + dz * dz > r * r) {
+        continue;
+      }
+      for (world_size_t dy = -vr; dy <= vr; ++dy) {
+        const chunk_key key{ std::get<0>(center) + dx,
+                             std::get<1>(center) + dy,
+                             std::get<2>(center) + dz };
+        if (all_chunks.count(key) || pending_chunks.count(key)) {
+          continue;
+        }
+        const float to_chunk[] = {
+          std::get<0>(key) * chunk_width + half_chunk_width - eye[0],
+          std::get<1>(key) * chunk_height + half_chunk_height - eye[1],
+          std::get<2>(key) * chunk_depth + half_chunk_depth - eye[2]
+        };
+        const float distance =
+            std::sqrt(to_chunk[0] * to_chunk[0] + to_chunk[1] * to_chunk[1] +
+                      to_chunk[2] * to_chunk[2]);
+        const float alignment =
+            distance > 0.0f ? (to_chunk[0] * view_direction[0] +
+                               to_chunk[1] * view_direction[1] +
+                               to_chunk[2] * view_direction[2]) /
+                                  distance
+                            : 1.0f;
+        candidates.push(
+            candidate{ distance * (1.5f - 0.5f * alignment), key });
+      }
     }
   }
+
+  while (!candidates.empty() &&
+         pending_chunks.size() < settings.max_pending) {
+    const auto key = candidates.top().second;
+    candidates.pop();
+    const auto s = storage;
+    const auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    // the camera's own column is what the player sees first
+    const auto priority = std::get<0>(key) == std::get<0>(center) &&
+                                  std::get<2>(key) == std::get<2>(center)
+                              ? job_priority::high
+                              : job_priority::normal;
+    auto &js = jobs;
+    const auto store = regions;
+    const auto world = seed;
+    const auto lattice = settings.density_lattice;
+    auto result =
+        jobs.submit([&js, store, key, s, world, lattice, cancelled]() {
+      return *cancelled
+                 ? std::make_tuple(key, chunk_ptr{})
+                 : load_or_generate(js, store, key, s, world, lattice);
+    }, priority);
+    pending_chunks[key] = pending_chunk{ std::move(result), cancelled };
+  }
+}
+
+void chunk_manager::update(const world_size_t x, const world_size_t y,
+                           const world_size_t z,
+                           const std::array<float, 3> &view_direction) {
+  center = chunk_key{ floor_div(x, chunk_width), floor_div(y, chunk_height),
+                      floor_div(z, chunk_depth) };
+  const std::array<float, 3> eye{ { static_cast<float>(x),
+                                    static_cast<float>(y),
+                                    static_cast<float>(z) } };
+  {
+    LEXOV_TIME_PHASE(frame_phase::streaming);
+    collect_generated_chunks(center);
+    unload_distant_chunks(center);
+    request_chunks(center, eye, view_direction);
+  }
+  LEXOV_TIME_PHASE(frame_phase::dirty_chunks);
+  update_meshes(center);
 }
+
 auto chunk_manager::get_total_number_of_solid_blocks() const -> decltype(
     chunk::volume) {
-    std::size_t count = 0;
-    for (auto &c : all_chunks) {
-      std::size_t chunk_solid_count = 0;
-      static const auto solid_counter = [&chunk_solid_count](const chunk &c, const local_size_t x, const local_size_t y, const local_size_t z) {
-        if (c.is_solid(x, y, z)) {
-          ++chunk_solid_count;
-        }
-      };
-      for_each_voxel(*c.second, solid_counter);
-      count += chunk_solid_count;
+  std::size_t count = 0;
+  for (const auto &c : all_chunks) {
+    count += c.second->count_solid_blocks();
+  }
+  return count;
+}
+
+world_statistics chunk_manager::get_statistics() const {
+  world_statistics statistics{};
+  statistics.chunks = all_chunks.size();
+  for (const auto &itr : all_chunks) {
+    const auto &c = *itr.second;
+    statistics.empty_chunks += c.is_empty();
+    statistics.full_chunks += c.is_full();
+    statistics.solid_blocks += c.count_solid_blocks();
+    for (std::size_t t = 0; t < statistics.blocks.size(); ++t) {
+      statistics.blocks[t] += c.count_blocks(static_cast<block_type>(t));
     }
-    return count;
+    statistics.sections += chunk::sections;
+    statistics.hidden_sections +=
+        chunk::sections -
+        __builtin_popcount(chunk_mesher::visible_sections(c));
+    const auto level = lod_levels.find(itr.first);
+    ++statistics.lod_chunks[level != lod_levels.end() ? level->second : 0];
   }
+  return statistics;
+}
 } // namespace lexov
 
@@ -1,7 +1,12 @@
 #pragma once
 #include "types.hpp"
 #include "chunk.hpp"
+#include "chunk_generator.hpp"
+#include "chunk_mesher.hpp"
+#include "flat_chunk_map.hpp"
 #include "utility.hpp"
+#include <array>
+#include <atomic>
 #include <future>
 #include <cstdint>
 #include <list>
@@ -11,20 +16,114 @@
 
 namespace lexov {
 
-class chunk_renderer;
+class job_system;
+class mesh_sink;
+class region_store;
+
+// Controls which chunks are kept around the camera, distances are in chunks
+struct streaming_settings {
+  // Chunks whose center is within this horizontal distance get loaded
+  world_size_t load_radius{ 16 };
+  // Loaded chunks are only dropped beyond this distance, so moving back and
+  // forth over a chunk border doesn't reload the same chunks
+  world_size_t unload_radius{ 18 };
+  // Chunk layers streamed above and below the camera's layer
+  world_size_t vertical_radius{ 3 };
+  // Generation jobs in flight at most
+  std::size_t max_pending{ 64 };
+  // Chunks beyond lod_radius[l - 1] horizontally are meshed at level l, see
+  // chunk_mesher::build_section_mesh
+  std::array<world_size_t, max_lod_level> lod_radius{ { 4, 8, 12 } };
+  // A chunk only changes its level once it is this much past the radius, so
+  // moving along a border doesn't remesh the chunks on it every frame
+  world_size_t lod_hysteresis{ 1 };
+  // Generated chunks sample their density noise every this many voxels and
+  // interpolate in between, see chunk_generator::make_floating_rock. Must
+  // divide the chunk size, see is_lattice_spacing.
+  local_size_t density_lattice{ default_density_lattice };
+};
+
+// Totals over the loaded chunks
+struct world_statistics {
+  std::size_t chunks;
+  std::size_t empty_chunks;
+  std::size_t full_chunks;
+  std::size_t solid_blocks;
+  std::array<std::size_t, static_cast<std::size_t>(block_type::count)> blocks;
+  // Sections of the loaded chunks, and those the mesher skips because they
+  // are empty or enclosed
+  std::size_t sections;
+  std::size_t hidden_sections;
+  // Chunks meshed at each level of detail
+  std::array<std::size_t, max_lod_level + 1> lod_chunks;
+};
 
 class chunk_manager {
 public:
-  chunk_manager(chunk_renderer &cr);
-  void update(const world_size_t x, const world_size_t y, const world_size_t z);
+  // Meshes of the loaded chunks are requested from sink, e.g. a
+  // chunk_renderer
+  chunk_manager(mesh_sink &sink, job_system &jobs,
+                const chunk_storage storage = chunk_storage::array,
+                const streaming_settings settings = streaming_settings{});
+  // Streams chunks in and out around the camera at (x, y, z). Chunks in the
+  // view direction are loaded before the ones behind the camera.
+  void update(const world_size_t x, const world_size_t y, const world_size_t z,
+              const std::array<float, 3> &view_direction);
+  // Throws std::runtime_error for invalid settings, as does the constructor,
+  // and for another density lattice than the store's while one is set
+  void set_streaming_settings(const streaming_settings settings);
+  // Chunks found in the store are loaded instead of generated, generated
+  // chunks are written back to it in the background. nullptr disables it.
+  // Takes over the seed and density lattice of the store, regions out of
+  // range are closed.
+  void set_region_store(region_store *store);
+  // Seed of the chunks generated from now on. A region store only holds
+  // chunks of its own seed, throws std::runtime_error for another seed while
+  // one is set.
+  void set_world_seed(const world_seed s);
   auto get_total_number_of_solid_blocks() const -> decltype(chunk::volume);
+  // O(chunks), the per chunk counts are maintained by chunk::set
+  world_statistics get_statistics() const;
+  std::size_t get_number_of_loaded_chunks() const { return all_chunks.size(); }
+  std::size_t get_number_of_pending_chunks() const {
+    return pending_chunks.size();
+  }
 private:
-  void insert_chunk(const chunk_key &key, chunk_ptr ptr); 
+  using generated_chunk = std::tuple<chunk_key, chunk_ptr>;
+
+  void insert_chunk(const chunk_key &key, chunk_ptr ptr);
   void remove_chunk(const chunk_key &key);
-  chunk_renderer &renderer;
+  void collect_generated_chunks(const chunk_key &center);
+  void unload_distant_chunks(const chunk_key &center);
+  void request_chunks(const chunk_key &center,
+                      const std::array<float, 3> &eye,
+                      const std::array<float, 3> &view_direction);
+  bool is_in_range(const chunk_key &center, const chunk_key &key,
+                   const world_size_t radius) const;
+  // Level of detail for key, current is kept within the hysteresis
+  unsigned select_lod(const chunk_key &center, const chunk_key &key,
+                      const unsigned current) const;
+  void update_meshes(const chunk_key &center);
+  mesh_sink &sink;
+  job_system &jobs;
+  chunk_storage storage;
+  streaming_settings settings;
+  region_store *regions{ nullptr };
+  world_seed seed{ default_world_seed };
 
-  using chunk_map = std::map<chunk_key, chunk_ptr>;
+  using chunk_map = flat_chunk_map<chunk_ptr>;
   using weak_chunk_map = std::map<chunk_key, weak_chunk_ptr>;
+  // Generation jobs that haven't started yet skip the work once cancelled
+  struct pending_chunk {
+    std::future<generated_chunk> result;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+  };
+  using pending_chunk_map = std::map<chunk_key, pending_chunk>;
   chunk_map all_chunks{};
+  pending_chunk_map pending_chunks{};
+  // Level each loaded chunk was last requested at
+  flat_chunk_map<std::uint8_t> lod_levels{};
+  // Chunk of the camera at the last update
+  chunk_key center{};
 };
 } // namespace
@@ -1,25 +1,30 @@
 #pragma once
 #include "types.hpp"
+#include "chunk_buffer.hpp"
+#include "visibility.hpp"
 #include <mogl/mogl.hpp>
 #include <array>
-#include <vector>
 
 namespace lexov {
 
-  struct voxel_vertex {
-    voxel_vertex(GLubyte x, GLubyte y, GLubyte z, block_type t)
-        : x{ x }, y{ y }, z{ z }, t{ static_cast<GLubyte>(t) } {}
-    GLubyte x;
-    GLubyte y;
-    GLubyte z;
-    GLubyte t;
+  struct section_mesh {
+    mogl::vertex_array_object vao;
+    mogl::stream_array_buffer vbo;
+    std::size_t number_of_vertices{ 0 };
   };
 
+  // One mesh per chunk section, an edit only re-uploads its section
   struct chunk_mesh {
-    mogl::vertex_array_object vao;
-    mogl::stream_array_buffer vbo;
-    std::size_t number_of_vertices;
+    std::array<section_mesh, chunk_sections> sections;
+    chunk_connectivity connectivity{ chunk_connectivity::all() };
+
+    std::size_t number_of_vertices() const {
+      std::size_t count = 0;
+      for (const auto &s : sections) {
+        count += s.number_of_vertices;
+      }
+      return count;
+    }
   };
 
-  using buffer_data = std::vector<voxel_vertex>;
 } // namespace lexov
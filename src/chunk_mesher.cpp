@@ -0,0 +1,480 @@
+#include "chunk_mesher.hpp"
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace {
+using namespace lexov;
+
+// Emits the quad covering the given face of the voxel box
+// [x0, x1) x [y0, y1) x [z0, z1), see buffer_data for the vertex order
+template <face face>
+void emit_face(buffer_data &mesh_data, const int x0, const int y0,
+               const int z0, const int x1, const int y1, const int z1,
+               const block_type t) {
+  switch (face) {
+  case face::front:
+    mesh_data.emplace_back(x0, y1, z0, face, t);
+    mesh_data.emplace_back(x0, y0, z0, face, t);
+    mesh_data.emplace_back(x1, y0, z0, face, t);
+    mesh_data.emplace_back(x1, y1, z0, face, t);
+    break;
+  case face::back:
+    mesh_data.emplace_back(x1, y1, z1, face, t);
+    mesh_data.emplace_back(x1, y0, z1, face, t);
+    mesh_data.emplace_back(x0, y0, z1, face, t);
+    mesh_data.emplace_back(x0, y1, z1, face, t);
+    break;
+  case face::left:
+    mesh_data.emplace_back(x0, y1, z1, face, t);
+    mesh_data.emplace_back(x0, y0, z1, face, t);
+    mesh_data.emplace_back(x0, y0, z0, face, t);
+    mesh_data.emplace_back(x0, y1, z0, face, t);
+    break;
+  case face::right:
+    mesh_data.emplace_back(x1, y1, z0, face, t);
+    mesh_data.emplace_back(x1, y0, z0, face, t);
+    mesh_data.emplace_back(x1, y0, z1, face, t);
+    mesh_data.emplace_back(x1, y1, z1, face, t);
+    break;
+  case face::top:
+    mesh_data.emplace_back(x0, y1, z1, face, t);
+    mesh_data.emplace_back(x0, y1, z0, face, t);
+    mesh_data.emplace_back(x1, y1, z0, face, t);
+    mesh_data.emplace_back(x1, y1, z1, face, t);
+    break;
+  case face::bottom:
+    mesh_data.emplace_back(x0, y0, z0, face, t);
+    mesh_data.emplace_back(x0, y0, z1, face, t);
+    mesh_data.emplace_back(x1, y0, z1, face, t);
+    mesh_data.emplace_back(x1, y0, z0, face, t);
+    break;
+  }
+}
+
+template <face face>
+void emit_visible_faces(buffer_data &mesh_data, const chunk_snapshot &s,
+                        const int x, const int z,
+                        const column_mask<chunk::height> &range) {
+  const auto visible = s.visible_faces<face>(x, z) & range;
+  visible.for_each_set_bit([&](const std::size_t y) {
+    emit_face<face>(mesh_data, x, y, z, x + 1, y + 1, z + 1, s.get(x, y, z));
+  });
+}
+
+using chunk_const_ptr = std::shared_ptr<const chunk>;
+
+// Missing neighbors read as air
+bool is_full_section(const chunk_const_ptr &c, const std::size_t s) {
+  return c && c->get_section_state(s) == section_state::full;
+}
+
+bool is_full_section(const chunk &c, const std::size_t s) {
+  return c.get_section_state(s) == section_state::full;
+}
+
+// Axis 0 is x, 1 is y and 2 is z. The normal axis of a face is sliced, the
+// two remaining axes span the 2D mask that gets merged into quads. step is
+// the direction the face looks at along the normal axis.
+template <face face> struct face_axes;
+template <> struct face_axes<face::front> {
+  static constexpr int n = 2, u = 0, v = 1, step = -1;
+};
+template <> struct face_axes<face::back> {
+  static constexpr int n = 2, u = 0, v = 1, step = 1;
+};
+template <> struct face_axes<face::left> {
+  static constexpr int n = 0, u = 2, v = 1, step = -1;
+};
+template <> struct face_axes<face::right> {
+  static constexpr int n = 0, u = 2, v = 1, step = 1;
+};
+template <> struct face_axes<face::top> {
+  static constexpr int n = 1, u = 0, v = 2, step = 1;
+};
+template <> struct face_axes<face::bottom> {
+  static constexpr int n = 1, u = 0, v = 2, step = -1;
+};
+
+// Merges the visible faces of one slice into quads and emits them. mask holds
+// the block_type of every visible face, block_type::air where there is none,
+// and is cleared on the way. Cell (i, j) of the mask lies at (u0 + i, v0 + j)
+// on the face axes; all coordinates are multiplied by scale.
+template <face face>
+void merge_quads(buffer_data &mesh_data, block_type *mask, const int mask_width,
+                 const int mask_height, const int slice, const int u0,
+                 const int v0, const int scale) {
+  using axes = face_axes<face>;
+  for (int j = 0; j < mask_height; ++j) {
+    for (int i = 0; i < mask_width;) {
+      const auto t = mask[i + j * mask_width];
+      if (t == block_type::air) {
+        ++i;
+        continue;
+      }
+      // grow the quad along u, then along v while every cell matches
+      int w = 1;
+      while (i + w < mask_width && mask[i + w + j * mask_width] == t) {
+        ++w;
+      }
+      int h = 1;
+      for (; j + h < mask_height; ++h) {
+        bool row_matches = true;
+        for (int k = 0; k < w; ++k) {
+          if (mask[i + k + (j + h) * mask_width] != t) {
+            row_matches = false;
+            break;
+          }
+        }
+        if (!row_matches) {
+          break;
+        }
+      }
+      for (int l = 0; l < h; ++l) {
+        for (int k = 0; k < w; ++k) {
+          mask[i + k + (j + l) * mask_width] = block_type::air;
+        }
+      }
+
+      int lo[3], hi[3];
+      lo[axes::n] = slice * scale;
+      hi[axes::n] = (slice + 1) * scale;
+      lo[axes::u] = (u0 + i) * scale;
+      hi[axes::u] = (u0 + i + w) * scale;
+      lo[axes::v] = (v0 + j) * scale;
+      hi[axes::v] = (v0 + j + h) * scale;
+      emit_face<face>(mesh_data, lo[0], lo[1], lo[2], hi[0], hi[1], hi[2], t);
+      i += w;
+    }
+  }
+}
+
+template <face face>
+void build_greedy_faces(buffer_data &mesh_data, const chunk_snapshot &c,
+                        const int y_begin, const int y_end) {
+  using axes = face_axes<face>;
+  static constexpr int dims[3] = { chunk::width, chunk::height, chunk::depth };
+  // Only y is limited, the mask is sized for the whole chunk
+  const int begin[3] = { 0, y_begin, 0 };
+  const int end[3] = { chunk::width, y_end, chunk::depth };
+  const int mask_width = end[axes::u] - begin[axes::u];
+  const int mask_height = end[axes::v] - begin[axes::v];
+  // block_type::air marks a face that is not visible
+  std::array<block_type, dims[axes::u] * dims[axes::v]> mask;
+  std::array<column_mask<chunk::height>, chunk::width * chunk::depth> visible;
+  for (int z = 0; z < chunk::depth; ++z) {
+    for (int x = 0; x < chunk::width; ++x) {
+      visible[x + chunk::width * z] = c.visible_faces<face>(x, z);
+    }
+  }
+
+  for (int slice = begin[axes::n]; slice < end[axes::n]; ++slice) {
+    int pos[3];
+    pos[axes::n] = slice;
+    for (int j = 0; j < mask_height; ++j) {
+      pos[axes::v] = begin[axes::v] + j;
+      for (int i = 0; i < mask_width; ++i) {
+        pos[axes::u] = begin[axes::u] + i;
+        mask[i + j * mask_width] =
+            visible[pos[0] + chunk::width * pos[2]].test(pos[1])
+                ? c.get(pos[0], pos[1], pos[2])
+                : block_type::air;
+      }
+    }
+
+    merge_quads<face>(mesh_data, mask.data(), mask_width, mask_height, slice,
+                      begin[axes::u], begin[axes::v], 1);
+  }
+}
+bool is_opaque_block(const block_type t) {
+  return is_solid_block(t) && !is_transparent_block(t);
+}
+
+// Snapshot downsampled by scale along every axis for the coarse layers
+// [y_begin, y_end), plus a one cell border. A cell is solid when any of its
+// voxels is and takes their most common block_type, so the coarse surface
+// encloses the fine one and no gap opens towards a neighbor meshed at
+// another level. A border cell is air when any voxel it covers is not
+// opaque, stone otherwise; only face adjacent border cells are filled. The
+// cells are kept in a caller provided buffer, reused across grids.
+class lod_grid {
+public:
+  lod_grid(const chunk_snapshot &s, const int scale, const int y_begin,
+           const int y_end, std::vector<block_type> &cells)
+      : scale{ scale }, width{ chunk::width / scale },
+        height{ chunk::height / scale }, depth{ chunk::depth / scale },
+        y_begin{ y_begin }, y_end{ y_end }, cells(cells) {
+    cells.assign((width + 2) * (y_end - y_begin + 2) * (depth + 2),
+                 block_type::air);
+    for (int z = -1; z <= depth; ++z) {
+      for (int y = y_begin - 1; y <= y_end; ++y) {
+        for (int x = -1; x <= width; ++x) {
+          const int outside = (x < 0 || x >= width) + (y < 0 || y >= height) +
+                              (z < 0 || z >= depth);
+          if (outside == 0) {
+            cells[index(x, y, z)] = downsample(s, x, y, z);
+          } else if (outside == 1) {
+            cells[index(x, y, z)] = border(s, x, y, z);
+          }
+        }
+      }
+    }
+  }
+
+  // Valid for x in [-1, width], y in [y_begin - 1, y_end], z in [-1, depth]
+  block_type get(const int x, const int y, const int z) const {
+    return cells[index(x, y, z)];
+  }
+
+  const int scale, width, height, depth, y_begin, y_end;
+
+private:
+  std::size_t index(const int x, const int y, const int z) const {
+    return (x + 1) +
+           (width + 2) * ((y - y_begin + 1) + (y_end - y_begin + 2) * (z + 1));
+  }
+
+  // Voxels [begin, end) covered by cell c along an axis with cells cells,
+  // the neighbor layer for the border cells
+  void voxel_range(const int c, const int cells, int &begin,
+                   int &end) const {
+    if (c < 0) {
+      begin = -1;
+      end = 0;
+    } else if (c >= cells) {
+      begin = cells * scale;
+      end = begin + 1;
+    } else {
+      begin = c * scale;
+      end = begin + scale;
+    }
+  }
+
+  template <class Function>
+  void for_each_voxel(const int x, const int y, const int z,
+                      const Function &f) const {
+    int x0, x1, y0, y1, z0, z1;
+    voxel_range(x, width, x0, x1);
+    voxel_range(y, height, y0, y1);
+    voxel_range(z, depth, z0, z1);
+    for (int vz = z0; vz < z1; ++vz) {
+      for (int vy = y0; vy < y1; ++vy) {
+        for (int vx = x0; vx < x1; ++vx) {
+          f(vx, vy, vz);
+        }
+      }
+    }
+  }
+
+  block_type downsample(const chunk_snapshot &s, const int x, const int y,
+                        const int z) const {
+    std::array<int, static_cast<std::size_t>(block_type::count)> votes{};
+    for_each_voxel(x, y, z, [&](const int vx, const int vy, const int vz) {
+      ++votes[static_cast<std::size_t>(s.get(vx, vy, vz))];
+    });
+    auto t = block_type::air;
+    int most = 0;
+    for (std::size_t i = 0; i < votes.size(); ++i) {
+      const auto candidate = static_cast<block_type>(i);
+      if (is_solid_block(candidate) && votes[i] > most) {
+        t = candidate;
+        most = votes[i];
+      }
+    }
+    return t;
+  }
+
+  block_type border(const chunk_snapshot &s, const int x, const int y,
+                    const int z) const {
+    bool opaque = true;
+    for_each_voxel(x, y, z, [&](const int vx, const int vy, const int vz) {
+      opaque = opaque && is_opaque_block(s.get(vx, vy, vz));
+    });
+    return opaque ? block_type::stone : block_type::air;
+  }
+
+  std::vector<block_type> &cells;
+};
+
+// build_greedy_faces on the cells of a lod_grid
+template <face face>
+void build_lod_faces(buffer_data &mesh_data, const lod_grid &g,
+                     std::vector<block_type> &mask) {
+  using axes = face_axes<face>;
+  const int begin[3] = { 0, g.y_begin, 0 };
+  const int end[3] = { g.width, g.y_end, g.depth };
+  const int mask_width = end[axes::u] - begin[axes::u];
+  const int mask_height = end[axes::v] - begin[axes::v];
+  mask.assign(mask_width * mask_height, block_type::air);
+
+  for (int slice = begin[axes::n]; slice < end[axes::n]; ++slice) {
+    int pos[3], next[3];
+    pos[axes::n] = slice;
+    next[axes::n] = slice + axes::step;
+    for (int j = 0; j < mask_height; ++j) {
+      pos[axes::v] = next[axes::v] = begin[axes::v] + j;
+      for (int i = 0; i < mask_width; ++i) {
+        pos[axes::u] = next[axes::u] = begin[axes::u] + i;
+        const auto t = g.get(pos[0], pos[1], pos[2]);
+        mask[i + j * mask_width] =
+            is_solid_block(t) && !is_opaque_block(g.get(next[0], next[1],
+                                                         next[2]))
+                ? t
+                : block_type::air;
+      }
+    }
+
+    merge_quads<face>(mesh_data, mask.data(), mask_width, mask_height, slice,
+                      begin[axes::u], begin[axes::v], g.scale);
+  }
+}
+} // namespace
+
+namespace lexov {
+
+void chunk_mesher::build_naive_mesh(buffer_data &mesh_data,
+                                    const chunk_snapshot &s, const int y_begin,
+                                    const int y_end) {
+  const auto range = column_mask<chunk::height>::range(y_begin, y_end);
+  for (auto z = 0; z < chunk::depth; ++z) {
+    for (auto x = 0; x < chunk::width; ++x) {
+      if ((s.get_column(x, z).solid & range).none()) {
+        continue;
+      }
+      emit_visible_faces<face::front>(mesh_data, s, x, z, range);
+      emit_visible_faces<face::back>(mesh_data, s, x, z, range);
+      emit_visible_faces<face::left>(mesh_data, s, x, z, range);
+      emit_visible_faces<face::right>(mesh_data, s, x, z, range);
+      emit_visible_faces<face::top>(mesh_data, s, x, z, range);
+      emit_visible_faces<face::bottom>(mesh_data, s, x, z, range);
+    }
+  }
+}
+
+void chunk_mesher::build_greedy_mesh(buffer_data &mesh_data,
+                                     const chunk_snapshot &s,
+                                     const int y_begin, const int y_end) {
+  build_greedy_faces<face::front>(mesh_data, s, y_begin, y_end);
+  build_greedy_faces<face::back>(mesh_data, s, y_begin, y_end);
+  build_greedy_faces<face::left>(mesh_data, s, y_begin, y_end);
+  build_greedy_faces<face::right>(mesh_data, s, y_begin, y_end);
+  build_greedy_faces<face::top>(mesh_data, s, y_begin, y_end);
+  build_greedy_faces<face::bottom>(mesh_data, s, y_begin, y_end);
+}
+
+void chunk_mesher::build_mesh(buffer_data &mesh_data, const chunk_snapshot &s,
+                              const mesh_mode mode) {
+  if (s.is_empty()) {
+    return;
+  }
+  switch (mode) {
+  case mesh_mode::naive:
+    build_naive_mesh(mesh_data, s);
+    break;
+  case mesh_mode::greedy:
+    build_greedy_mesh(mesh_data, s);
+    break;
+  }
+}
+
+void chunk_mesher::build_section_mesh(buffer_data &mesh_data,
+                                      const chunk_snapshot &s,
+                                      const mesh_mode mode,
+                                      const std::size_t section,
+                                      const unsigned level) {
+  if (s.is_empty()) {
+    return;
+  }
+  if (level > 0) {
+    const int scale = 1 << level;
+    const int layers = section_height / scale;
+    const int y_begin = static_cast<int>(section) * layers;
+    static thread_local std::vector<block_type> cells, mask;
+    const lod_grid g{ s, scale, y_begin, y_begin + layers, cells };
+    build_lod_faces<face::front>(mesh_data, g, mask);
+    build_lod_faces<face::back>(mesh_data, g, mask);
+    build_lod_faces<face::left>(mesh_data, g, mask);
+    build_lod_faces<face::right>(mesh_data, g, mask);
+    build_lod_faces<face::top>(mesh_data, g, mask);
+    build_lod_faces<face::bottom>(mesh_data, g, mask);
+    return;
+  }
+  const int y_begin = section * section_height;
+  const int y_end = std::min<int>(y_begin + section_height, chunk::height);
+  switch (mode) {
+  case mesh_mode::naive:
+    build_naive_mesh(mesh_data, s, y_begin, y_end);
+    break;
+  case mesh_mode::greedy:
+    build_greedy_mesh(mesh_data, s, y_begin, y_end);
+    break;
+  }
+}
+
+section_mask chunk_mesher::visible_sections(const chunk &c) {
+  if (c.is_empty()) {
+    return 0;
+  }
+  const auto front = c.get_neighbor<face::front>();
+  const auto back = c.get_neighbor<face::back>();
+  const auto left = c.get_neighbor<face::left>();
+  const auto right = c.get_neighbor<face::right>();
+  const auto top = c.get_neighbor<face::top>();
+  const auto bottom = c.get_neighbor<face::bottom>();
+  section_mask visible = 0;
+  for (std::size_t s = 0; s < chunk::sections; ++s) {
+    const auto state = c.get_section_state(s);
+    if (state == section_state::empty) {
+      continue;
+    }
+    const bool enclosed =
+        state == section_state::full &&
+        (s + 1 < chunk::sections ? is_full_section(c, s + 1)
+                                 : is_full_section(top, 0)) &&
+        (s > 0 ? is_full_section(c, s - 1)
+               : is_full_section(bottom, chunk::sections - 1)) &&
+        is_full_section(front, s) && is_full_section(back, s) &&
+        is_full_section(left, s) && is_full_section(right, s);
+    if (!enclosed) {
+      visible |= chunk::section_bit(s);
+    }
+  }
+  return visible;
+}
+
+bool chunk_mesher::has_visible_faces(const chunk &c) {
+  return visible_sections(c) != 0;
+}
+
+void chunk_mesher::build_mesh(buffer_data &mesh_data, const chunk &c,
+                              const mesh_mode mode) {
+  const auto visible = visible_sections(c);
+  if (visible == 0) {
+    return;
+  }
+  chunk_snapshot s;
+  s.load(c);
+  // Runs of visible sections are meshed in one go, so greedy quads still
+  // span section borders
+  for (std::size_t begin = 0; begin < chunk::sections;) {
+    if (!(visible & chunk::section_bit(begin))) {
+      ++begin;
+      continue;
+    }
+    auto end = begin + 1;
+    while (end < chunk::sections && (visible & chunk::section_bit(end))) {
+      ++end;
+    }
+    const int y_begin = begin * section_height;
+    const int y_end = std::min<int>(end * section_height, chunk::height);
+    if (mode == mesh_mode::naive) {
+      build_naive_mesh(mesh_data, s, y_begin, y_end);
+    } else {
+      build_greedy_mesh(mesh_data, s, y_begin, y_end);
+    }
+    begin = end;
+  }
+}
+
+} // namespace lexov
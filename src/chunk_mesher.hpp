@@ -0,0 +1,49 @@
+#pragma once
+#include "chunk.hpp"
+#include "chunk_buffer.hpp"
+#include "types.hpp"
+
+namespace lexov {
+
+enum class mesh_mode : std::uint_least8_t {
+  naive, greedy
+};
+
+// Coarsest level of detail, see chunk_mesher::build_section_mesh
+constexpr const unsigned max_lod_level = 3;
+static_assert(section_height % (1 << max_lod_level) == 0 &&
+                  chunk_width % (1 << max_lod_level) == 0 &&
+                  chunk_depth % (1 << max_lod_level) == 0,
+              "cells of the coarsest level split neither sections nor chunks");
+
+namespace chunk_mesher {
+  // Both meshers only emit the faces of voxels with y in [y_begin, y_end),
+  // vertices stay relative to the chunk.
+  // Emits two triangles for every visible voxel face
+  void build_naive_mesh(buffer_data &mesh_data, const chunk_snapshot &s,
+                        const int y_begin = 0, const int y_end = chunk::height);
+  // Merges coplanar, same block_type faces into larger quads
+  void build_greedy_mesh(buffer_data &mesh_data, const chunk_snapshot &s,
+                         const int y_begin = 0,
+                         const int y_end = chunk::height);
+  void build_mesh(buffer_data &mesh_data, const chunk_snapshot &s,
+                  const mesh_mode mode);
+  // Meshes one section of the chunk, see chunk_base::sections. Levels above
+  // zero merge 2^level voxels along every axis into one cell and always
+  // mesh greedily; a cell with any solid voxel is solid, so the coarse mesh
+  // covers the fine one and leaves no cracks next to finer neighbors.
+  void build_section_mesh(buffer_data &mesh_data, const chunk_snapshot &s,
+                          const mesh_mode mode, const std::size_t section,
+                          const unsigned level = 0);
+  // Sections of c that may have a visible face. Empty sections and full
+  // sections enclosed by six full sections, in c or its neighbors, are left
+  // out. Reads the section summaries only, no snapshot needed.
+  section_mask visible_sections(const chunk &c);
+  // False when no section of c can have a visible face
+  bool has_visible_faces(const chunk &c);
+  // Snapshots c and its neighbors, then meshes the visible sections of the
+  // snapshot
+  void build_mesh(buffer_data &mesh_data, const chunk &c, const mesh_mode mode);
+}
+
+} // namespace lexov
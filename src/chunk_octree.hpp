@@ -0,0 +1,312 @@
+#pragma once
+#include "chunk_base.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace lexov {
+
+// Stores the chunk as a stack of W^3 cubes, each a sparse voxel octree whose
+// uniform nodes collapse into a single leaf. A chunk of air and stone
+// regions needs a few hundred nodes instead of one byte per voxel, and get
+// descends at most log2(W) levels. for_each_solid_leaf visits the solid
+// regions without touching the air, get_voxels and get_occupancy are built
+// on it.
+template <local_size_t W, local_size_t H = W, local_size_t D = W>
+class octree_chunk : public chunk_base<W, H, D> {
+public:
+  using chunk_base_whd = chunk_base<W, H, D>;
+  static_assert(W == D && (W & (W - 1)) == 0 && H % W == 0,
+                "the chunk is a stack of power of two cubes");
+  static constexpr std::size_t cubes = H / W;
+
+  octree_chunk() : nodes(cubes, make_leaf(block_type::air)) {}
+
+  // Calls f(x, y, z, size, type) for every leaf that is not air, the cube
+  // [x, x + size) x [y, y + size) x [z, z + size) holds only type
+  template <class Function> void for_each_solid_leaf(const Function &f) const;
+
+  // Nodes in use, collapsed subtrees are not counted
+  std::size_t number_of_nodes() const {
+    return nodes.size() - free_groups.size() * 8;
+  }
+
+private:
+  // A node is either a leaf holding a block_type or the number g of the group
+  // of eight children it splits into, stored at nodes [cubes + 8 g, cubes +
+  // 8 g + 8). Nodes [0, cubes) are the roots of the cubes from bottom to top.
+  using node = std::uint16_t;
+  static constexpr node leaf_bit = 0x8000;
+  static_assert(cubes * (W * W * W - 1) / 7 < leaf_bit,
+                "every group of a full tree has a number");
+  using occupancy = typename chunk_base_whd::occupancy;
+
+  std::vector<node> nodes;
+  // Groups of collapsed nodes, reused by split
+  std::vector<node> free_groups{};
+
+  static node make_leaf(const block_type t) {
+    return leaf_bit | static_cast<node>(t);
+  }
+  static bool is_leaf(const node n) { return n & leaf_bit; }
+  static block_type leaf_type(const node n) {
+    return static_cast<block_type>(n & ~leaf_bit);
+  }
+  static std::size_t first_child(const node n) { return cubes + 8 * n; }
+  // Child of a node of size 2 * half that holds (x, y, z)
+  static node octant(const local_size_t x, const local_size_t y,
+                     const local_size_t z, const local_size_t half) {
+    return (x & half ? 1 : 0) | (y & half ? 2 : 0) | (z & half ? 4 : 0);
+  }
+
+  block_type get_impl(const local_size_t x, const local_size_t y,
+                      const local_size_t z) const override;
+  block_type set_impl(const local_size_t x, const local_size_t y,
+                      const local_size_t z, const block_type type) override;
+  bool is_solid_impl(const local_size_t x, const local_size_t y,
+                     const local_size_t z) const override;
+  bool is_transparent_impl(const local_size_t x, const local_size_t y,
+                           const local_size_t z) const override;
+  void get_row_impl(const local_size_t y, const local_size_t z,
+                    block_type *out) const override;
+  void get_voxels_impl(block_type *out, const std::size_t y_stride,
+                       const std::size_t z_stride) const override;
+  void get_occupancy_impl(occupancy &out) const override;
+  void shrink_to_fit_impl() override;
+  std::size_t memory_usage_impl() const override {
+    return sizeof(*this) + nodes.capacity() * sizeof(node) +
+           free_groups.capacity() * sizeof(node);
+  }
+
+  // Turns leaf i into a node with eight children of the same type
+  void split(const std::size_t i);
+  void get_row(const node n, const local_size_t x, const local_size_t y,
+               const local_size_t z, const local_size_t size,
+               block_type *out) const;
+  template <class Function>
+  void for_each_solid_leaf(const node n, const local_size_t x,
+                           const local_size_t y, const local_size_t z,
+                           const local_size_t size, const Function &f) const;
+  // Appends the subtree of n to compacted, returns its new node
+  node compact(const node n, std::vector<node> &compacted) const;
+};
+
+template <local_size_t W, local_size_t H, local_size_t D>
+block_type
+octree_chunk<W, H, D>::get_impl(const local_size_t x, const local_size_t y,
+                                const local_size_t z) const {
+  auto n = nodes[y / W];
+  for (local_size_t half = W / 2; !is_leaf(n); half /= 2) {
+    n = nodes[first_child(n) + octant(x, y, z, half)];
+  }
+  return leaf_type(n);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+block_type octree_chunk<W, H, D>::set_impl(const local_size_t x,
+                                           const local_size_t y,
+                                           const local_size_t z,
+                                           const block_type type) {
+  // Nodes from the root down to the voxel
+  std::array<std::size_t, 32> path;
+  std::size_t depth = 0;
+  std::size_t i = y / W;
+  path[0] = i;
+  for (local_size_t half = W / 2; half > 0; half /= 2) {
+    if (is_leaf(nodes[i])) {
+      if (leaf_type(nodes[i]) == type) {
+        return type;
+      }
+      split(i);
+    }
+    i = first_child(nodes[i]) + octant(x, y, z, half);
+    path[++depth] = i;
+  }
+  const auto previous = leaf_type(nodes[i]);
+  nodes[i] = make_leaf(type);
+  // Collapse the parents whose children now all hold the same type
+  while (depth > 0) {
+    const auto parent = path[--depth];
+    const auto group = nodes[parent];
+    const auto first = nodes.begin() + first_child(group);
+    const auto leaf = nodes[i];
+    if (!std::all_of(first, first + 8,
+                     [leaf](const node n) { return n == leaf; })) {
+      break;
+    }
+    nodes[parent] = leaf;
+    free_groups.push_back(group);
+    i = parent;
+  }
+  return previous;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void octree_chunk<W, H, D>::split(const std::size_t i) {
+  const auto leaf = nodes[i];
+  node group;
+  if (!free_groups.empty()) {
+    group = free_groups.back();
+    free_groups.pop_back();
+    std::fill(nodes.begin() + first_child(group),
+              nodes.begin() + first_child(group) + 8, leaf);
+  } else {
+    group = static_cast<node>((nodes.size() - cubes) / 8);
+    nodes.insert(nodes.end(), 8, leaf);
+  }
+  nodes[i] = group;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+bool octree_chunk<W, H, D>::is_solid_impl(const local_size_t x,
+                                          const local_size_t y,
+                                          const local_size_t z) const {
+  return is_solid_block(get_impl(x, y, z));
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+bool octree_chunk<W, H, D>::is_transparent_impl(const local_size_t x,
+                                                const local_size_t y,
+                                                const local_size_t z) const {
+  return is_transparent_block(get_impl(x, y, z));
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void octree_chunk<W, H, D>::get_row_impl(const local_size_t y,
+                                         const local_size_t z,
+                                         block_type *out) const {
+  get_row(nodes[y / W], 0, y, z, W, out);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void octree_chunk<W, H, D>::get_row(const node n, const local_size_t x,
+                                    const local_size_t y, const local_size_t z,
+                                    const local_size_t size,
+                                    block_type *out) const {
+  if (is_leaf(n)) {
+    std::fill(out + x, out + x + size, leaf_type(n));
+    return;
+  }
+  // the row crosses the two children along x at its (y, z)
+  const auto half = size / 2;
+  const auto first = first_child(n) + octant(0, y, z, half);
+  get_row(nodes[first], x, y, z, half, out);
+  get_row(nodes[first + 1], x + half, y, z, half, out);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void octree_chunk<W, H, D>::get_voxels_impl(block_type *out,
+                                            const std::size_t y_stride,
+                                            const std::size_t z_stride) const {
+  for_each_solid_leaf([=](const local_size_t x, const local_size_t y,
+                          const local_size_t z, const local_size_t size,
+                          const block_type t) {
+    if (size == 1) {
+      out[x + y_stride * y + z_stride * z] = t;
+      return;
+    }
+    for (local_size_t dz = 0; dz < size; ++dz) {
+      for (local_size_t dy = 0; dy < size; ++dy) {
+        const auto row = out + x + y_stride * (y + dy) + z_stride * (z + dz);
+        std::fill(row, row + size, t);
+      }
+    }
+  });
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void octree_chunk<W, H, D>::get_occupancy_impl(occupancy &out) const {
+  out.fill(column_occupancy<H>{});
+  for_each_solid_leaf([&out](const local_size_t x, const local_size_t y,
+                             const local_size_t z, const local_size_t size,
+                             const block_type t) {
+    const bool opaque = !is_transparent_block(t);
+    if (size == 1) {
+      out[x + W * z].set(y, true, opaque);
+      return;
+    }
+    const auto range = column_mask<H>::range(y, y + size);
+    for (local_size_t dz = 0; dz < size; ++dz) {
+      for (local_size_t dx = 0; dx < size; ++dx) {
+        auto &column = out[x + dx + W * (z + dz)];
+        column.solid = column.solid | range;
+        if (opaque) {
+          column.opaque = column.opaque | range;
+        }
+      }
+    }
+  });
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+template <class Function>
+void octree_chunk<W, H, D>::for_each_solid_leaf(const Function &f) const {
+  for (std::size_t c = 0; c < cubes; ++c) {
+    for_each_solid_leaf(nodes[c], 0, c * W, 0, W, f);
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+template <class Function>
+void octree_chunk<W, H, D>::for_each_solid_leaf(
+    const node n, const local_size_t x, const local_size_t y,
+    const local_size_t z, const local_size_t size, const Function &f) const {
+  if (is_leaf(n)) {
+    if (is_solid_block(leaf_type(n))) {
+      f(x, y, z, size, leaf_type(n));
+    }
+    return;
+  }
+  const auto half = size / 2;
+  const auto first = first_child(n);
+  if (half == 1) {
+    // single voxels, most leaves of a noisy chunk end up here
+    for (node i = 0; i < 8; ++i) {
+      const auto t = leaf_type(nodes[first + i]);
+      if (is_solid_block(t)) {
+        f(x + (i & 1), y + (i >> 1 & 1), z + (i >> 2), 1, t);
+      }
+    }
+    return;
+  }
+  for (node i = 0; i < 8; ++i) {
+    for_each_solid_leaf(nodes[first + i], x + (i & 1 ? half : 0),
+                        y + (i & 2 ? half : 0), z + (i & 4 ? half : 0), half,
+                        f);
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void octree_chunk<W, H, D>::shrink_to_fit_impl() {
+  // Drop the collapsed groups and store every subtree depth first
+  std::vector<node> compacted(nodes.begin(), nodes.begin() + cubes);
+  for (std::size_t c = 0; c < cubes; ++c) {
+    const auto root = compact(nodes[c], compacted);
+    compacted[c] = root;
+  }
+  compacted.shrink_to_fit();
+  nodes.swap(compacted);
+  free_groups.clear();
+  free_groups.shrink_to_fit();
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+auto octree_chunk<W, H, D>::compact(const node n,
+                                    std::vector<node> &compacted) const
+    -> node {
+  if (is_leaf(n)) {
+    return n;
+  }
+  const auto first = compacted.size();
+  compacted.insert(compacted.end(), 8, node{ 0 });
+  for (node i = 0; i < 8; ++i) {
+    // compact may reallocate compacted, so no reference into it is kept
+    const auto child = compact(nodes[first_child(n) + i], compacted);
+    compacted[first + i] = child;
+  }
+  return static_cast<node>((first - cubes) / 8);
+}
+
+} // namespace lexov
@@ -0,0 +1,207 @@
+#pragma once
+#include "chunk_base.hpp"
+#include "column_mask.hpp"
+#include "types.hpp"
+#include <array>
+#include <cstddef>
+
+namespace lexov {
+
+// Immutable dense copy of a chunk plus a one voxel border holding the
+// adjacent voxels of its face neighbors. Missing neighbors read as air, the
+// same as chunk_base::is_face_visible. Loading costs one virtual get_row per
+// row; after that every access is a statically dispatched array read.
+// Column occupancy masks are copied alongside so faces of a whole column can
+// be culled with a few word operations.
+template <local_size_t W, local_size_t H = W, local_size_t D = W>
+class padded_chunk {
+public:
+  static constexpr local_size_t width = W;
+  static constexpr local_size_t height = H;
+  static constexpr local_size_t depth = D;
+  static constexpr int padded_width = W + 2;
+  static constexpr int padded_height = H + 2;
+  static constexpr int padded_depth = D + 2;
+  static constexpr std::size_t padded_volume =
+      padded_width * padded_height * padded_depth;
+
+  void load(const chunk_base<W, H, D> &c);
+
+  // Valid for x in [-1, W], y in [-1, H] and z in [-1, D]
+  block_type get(const int x, const int y, const int z) const {
+    return data[get_1D_index(x, y, z)];
+  }
+
+  template <face face>
+  bool is_face_visible(const int x, const int y, const int z) const;
+
+  // Bit y is set when the given face of voxel (x, y, z) is visible, valid for
+  // x in [0, W) and z in [0, D)
+  template <face face>
+  column_mask<H> visible_faces(const int x, const int z) const;
+
+  // True when the chunk itself holds no solid voxel
+  bool is_empty() const;
+
+  // Occupancy of column (x, z), valid for x in [-1, W] and z in [-1, D]
+  const column_occupancy<H> &get_column(const int x, const int z) const {
+    return columns[get_column_index(x, z)];
+  }
+
+private:
+  using padded_data = std::array<block_type, padded_volume>;
+  using padded_columns =
+      std::array<column_occupancy<H>, padded_width * padded_depth>;
+  padded_data data;
+  padded_columns columns;
+
+  static std::size_t get_column_index(const int x, const int z) {
+    return (x + 1) + padded_width * (z + 1);
+  }
+
+  bool is_opaque(const int x, const int y, const int z) const {
+    const auto t = get(x, y, z);
+    return is_solid_block(t) && !is_transparent_block(t);
+  }
+
+  void load_border_column(const int x, const int z);
+
+  static std::size_t get_1D_index(const int x, const int y, const int z) {
+    return (x + 1) + padded_width * (y + 1) +
+           padded_width * padded_height * (z + 1);
+  }
+};
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void padded_chunk<W, H, D>::load(const chunk_base<W, H, D> &c) {
+  data.fill(block_type::air);
+  c.get_voxels(&data[get_1D_index(0, 0, 0)], padded_width,
+               padded_width * padded_height);
+
+  if (const auto neighbor = c.template get_neighbor<face::front>()) {
+    for (int y = 0; y < H; ++y) {
+      neighbor->get_row(y, D - 1, &data[get_1D_index(0, y, -1)]);
+    }
+  }
+  if (const auto neighbor = c.template get_neighbor<face::back>()) {
+    for (int y = 0; y < H; ++y) {
+      neighbor->get_row(y, 0, &data[get_1D_index(0, y, D)]);
+    }
+  }
+  if (const auto neighbor = c.template get_neighbor<face::bottom>()) {
+    for (int z = 0; z < D; ++z) {
+      neighbor->get_row(H - 1, z, &data[get_1D_index(0, -1, z)]);
+    }
+  }
+  if (const auto neighbor = c.template get_neighbor<face::top>()) {
+    for (int z = 0; z < D; ++z) {
+      neighbor->get_row(0, z, &data[get_1D_index(0, H, z)]);
+    }
+  }
+  if (const auto neighbor = c.template get_neighbor<face::left>()) {
+    for (int z = 0; z < D; ++z) {
+      for (int y = 0; y < H; ++y) {
+        data[get_1D_index(-1, y, z)] = neighbor->get(W - 1, y, z);
+      }
+    }
+  }
+  if (const auto neighbor = c.template get_neighbor<face::right>()) {
+    for (int z = 0; z < D; ++z) {
+      for (int y = 0; y < H; ++y) {
+        data[get_1D_index(W, y, z)] = neighbor->get(0, y, z);
+      }
+    }
+  }
+
+  typename chunk_base<W, H, D>::occupancy interior;
+  c.get_occupancy(interior);
+  for (int z = 0; z < D; ++z) {
+    for (int x = 0; x < W; ++x) {
+      columns[get_column_index(x, z)] = interior[x + W * z];
+    }
+  }
+  for (int i = 0; i < W; ++i) {
+    load_border_column(i, -1);
+    load_border_column(i, D);
+  }
+  for (int i = 0; i < D; ++i) {
+    load_border_column(-1, i);
+    load_border_column(W, i);
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void padded_chunk<W, H, D>::load_border_column(const int x, const int z) {
+  auto &column = columns[get_column_index(x, z)];
+  for (int y = 0; y < H; ++y) {
+    column.set(y, is_solid_block(get(x, y, z)), is_opaque(x, y, z));
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+template <face face>
+bool padded_chunk<W, H, D>::is_face_visible(const int x, const int y,
+                                            const int z) const {
+  if (!is_solid_block(get(x, y, z))) {
+    return false;
+  }
+  block_type neighbor{};
+  switch (face) {
+  case face::front:
+    neighbor = get(x, y, z - 1);
+    break;
+  case face::back:
+    neighbor = get(x, y, z + 1);
+    break;
+  case face::left:
+    neighbor = get(x - 1, y, z);
+    break;
+  case face::right:
+    neighbor = get(x + 1, y, z);
+    break;
+  case face::top:
+    neighbor = get(x, y + 1, z);
+    break;
+  case face::bottom:
+    neighbor = get(x, y - 1, z);
+    break;
+  }
+  return !is_solid_block(neighbor) || is_transparent_block(neighbor);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+bool padded_chunk<W, H, D>::is_empty() const {
+  for (int z = 0; z < D; ++z) {
+    for (int x = 0; x < W; ++x) {
+      if (!get_column(x, z).solid.none()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+template <face face>
+column_mask<H> padded_chunk<W, H, D>::visible_faces(const int x,
+                                                   const int z) const {
+  const auto &column = get_column(x, z);
+  switch (face) {
+  case face::front:
+    return column.solid.and_not(get_column(x, z - 1).opaque);
+  case face::back:
+    return column.solid.and_not(get_column(x, z + 1).opaque);
+  case face::left:
+    return column.solid.and_not(get_column(x - 1, z).opaque);
+  case face::right:
+    return column.solid.and_not(get_column(x + 1, z).opaque);
+  case face::top:
+    return column.solid.and_not(
+        column.opaque.shifted_down(is_opaque(x, H, z)));
+  case face::bottom:
+    return column.solid.and_not(
+        column.opaque.shifted_up(is_opaque(x, -1, z)));
+  }
+}
+
+} // namespace lexov
@@ -0,0 +1,217 @@
+#pragma once
+#include "chunk_base.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace lexov {
+
+// Stores a small palette of the block types present in the chunk plus one
+// bit-packed palette index per voxel. A chunk made of a single block type
+// needs no index storage at all; the index width doubles (1, 2, 4, 8 bits)
+// whenever the palette outgrows it.
+template <local_size_t W, local_size_t H = W, local_size_t D = W>
+class palette_chunk : public chunk_base<W, H, D> {
+public:
+  using chunk_base_whd = chunk_base<W, H, D>;
+
+  bool is_uniform() const { return bits_per_index == 0; }
+  std::size_t palette_size() const { return palette.size(); }
+
+private:
+  using word = std::uint64_t;
+  using occupancy = typename chunk_base_whd::occupancy;
+  static constexpr unsigned bits_per_word = 64;
+
+  std::vector<block_type> palette{ block_type::air };
+  std::vector<word> indices{};
+  unsigned bits_per_index{ 0 };
+
+  block_type get_impl(const local_size_t x, const local_size_t y,
+                      const local_size_t z) const override;
+  block_type set_impl(const local_size_t x, const local_size_t y,
+                      const local_size_t z, const block_type type) override;
+  bool is_solid_impl(const local_size_t x, const local_size_t y,
+                     const local_size_t z) const override;
+  bool is_transparent_impl(const local_size_t x, const local_size_t y,
+                           const local_size_t z) const override;
+  void get_row_impl(const local_size_t y, const local_size_t z,
+                    block_type *out) const override;
+  void get_occupancy_impl(occupancy &out) const override;
+  void shrink_to_fit_impl() override;
+  std::size_t memory_usage_impl() const override;
+
+  inline auto get_1D_index(
+      const local_size_t x, const local_size_t y,
+      const local_size_t z) const -> decltype(chunk_base_whd::volume) {
+    return x + W * y + W * H * z;
+  }
+
+  std::size_t read_index(const std::size_t i) const {
+    if (bits_per_index == 0) {
+      return 0;
+    }
+    const auto bit = i * bits_per_index;
+    const word mask = (word{ 1 } << bits_per_index) - 1;
+    return (indices[bit / bits_per_word] >> (bit % bits_per_word)) & mask;
+  }
+
+  void write_index(const std::size_t i, const std::size_t value) {
+    const auto bit = i * bits_per_index;
+    const word mask = (word{ 1 } << bits_per_index) - 1;
+    auto &w = indices[bit / bits_per_word];
+    w = (w & ~(mask << (bit % bits_per_word))) |
+        (static_cast<word>(value) << (bit % bits_per_word));
+  }
+
+  // Repacks every index with the new width
+  void resize_indices(const unsigned bits);
+};
+
+template <local_size_t W, local_size_t H, local_size_t D>
+block_type
+palette_chunk<W, H, D>::get_impl(const local_size_t x, const local_size_t y,
+                                 const local_size_t z) const {
+  return palette[read_index(get_1D_index(x, y, z))];
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+block_type palette_chunk<W, H, D>::set_impl(const local_size_t x,
+                                            const local_size_t y,
+                                            const local_size_t z,
+                                            const block_type type) {
+  const auto i = get_1D_index(x, y, z);
+  const auto previous = palette[read_index(i)];
+  if (previous == type) {
+    return previous;
+  }
+  auto entry = std::find(palette.begin(), palette.end(), type);
+  if (entry == palette.end()) {
+    if (palette.size() >= (std::size_t{ 1 } << bits_per_index)) {
+      resize_indices(bits_per_index == 0 ? 1 : bits_per_index * 2);
+    }
+    palette.push_back(type);
+    entry = palette.end() - 1;
+  }
+  write_index(i, entry - palette.begin());
+  return previous;
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+bool palette_chunk<W, H, D>::is_solid_impl(const local_size_t x,
+                                           const local_size_t y,
+                                           const local_size_t z) const {
+  return is_solid_block(get_impl(x, y, z));
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+bool palette_chunk<W, H, D>::is_transparent_impl(const local_size_t x,
+                                                 const local_size_t y,
+                                                 const local_size_t z) const {
+  return is_transparent_block(get_impl(x, y, z));
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void palette_chunk<W, H, D>::get_row_impl(const local_size_t y,
+                                          const local_size_t z,
+                                          block_type *out) const {
+  if (is_uniform()) {
+    std::fill(out, out + W, palette[0]);
+    return;
+  }
+  const auto begin = get_1D_index(0, y, z);
+  for (std::size_t x = 0; x < W; ++x) {
+    out[x] = palette[read_index(begin + x)];
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void palette_chunk<W, H, D>::get_occupancy_impl(occupancy &out) const {
+  if (!is_uniform()) {
+    chunk_base_whd::get_occupancy_impl(out);
+    return;
+  }
+  const auto t = palette[0];
+  column_occupancy<H> column;
+  for (std::size_t y = 0; y < H; ++y) {
+    column.set(y, is_solid_block(t),
+               is_solid_block(t) && !is_transparent_block(t));
+  }
+  out.fill(column);
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void palette_chunk<W, H, D>::resize_indices(const unsigned bits) {
+  std::vector<word> repacked((chunk_base_whd::volume * bits + bits_per_word - 1) /
+                             bits_per_word);
+  std::swap(indices, repacked);
+  const auto old_bits = bits_per_index;
+  bits_per_index = bits;
+  if (old_bits == 0) {
+    // every voxel referenced palette entry 0, which is all zero bits
+    return;
+  }
+  const word old_mask = (word{ 1 } << old_bits) - 1;
+  for (std::size_t i = 0; i < chunk_base_whd::volume; ++i) {
+    const auto bit = i * old_bits;
+    write_index(i,
+                (repacked[bit / bits_per_word] >> (bit % bits_per_word)) &
+                    old_mask);
+  }
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+void palette_chunk<W, H, D>::shrink_to_fit_impl() {
+  if (is_uniform()) {
+    return;
+  }
+  // drop palette entries no voxel references any more. Palettes have at
+  // most 256 entries, so the bookkeeping fits on the stack; generators call
+  // this for every chunk on the workers.
+  std::array<bool, 256> used{};
+  for (std::size_t i = 0; i < chunk_base_whd::volume; ++i) {
+    used[read_index(i)] = true;
+  }
+  std::array<std::uint8_t, 256> remap{};
+  std::size_t kept = 0;
+  for (std::size_t p = 0; p < palette.size(); ++p) {
+    if (used[p]) {
+      remap[p] = static_cast<std::uint8_t>(kept);
+      palette[kept++] = palette[p];
+    }
+  }
+  if (kept == palette.size()) {
+    return;
+  }
+  palette.resize(kept);
+  unsigned bits = 0;
+  while ((std::size_t{ 1 } << bits) < kept) {
+    bits = bits == 0 ? 1 : bits * 2;
+  }
+  // The indices only get narrower, so repacking front to back in place
+  // never overwrites an index before it was read
+  const auto old_bits = bits_per_index;
+  const word old_mask = (word{ 1 } << old_bits) - 1;
+  bits_per_index = bits;
+  if (bits) {
+    for (std::size_t i = 0; i < chunk_base_whd::volume; ++i) {
+      const auto bit = i * old_bits;
+      write_index(i, remap[(indices[bit / bits_per_word] >>
+                            (bit % bits_per_word)) & old_mask]);
+    }
+  }
+  indices.resize((chunk_base_whd::volume * bits + bits_per_word - 1) /
+                 bits_per_word);
+  indices.shrink_to_fit();
+  palette.shrink_to_fit();
+}
+
+template <local_size_t W, local_size_t H, local_size_t D>
+std::size_t palette_chunk<W, H, D>::memory_usage_impl() const {
+  return sizeof(*this) + palette.capacity() * sizeof(block_type) +
+         indices.capacity() * sizeof(word);
+}
+
+} // namespace lexov
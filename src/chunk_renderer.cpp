@@ -1,5 +1,8 @@
 #include "chunk_renderer.hpp"
 #include "camera.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <iostream>
 namespace lexov {
 
@@ -10,9 +13,14 @@ const std::string chunk_renderer::camera_pos_uniform_name = "vp_matrix";
 const std::string chunk_renderer::texture_uniform_name = "my_texture";
 const std::string chunk_renderer::view_matrix_name = "v_matrix";
 
-chunk_renderer::chunk_renderer(mogl::program program)
-    : shader_program{ std::move(program) } {
+chunk_renderer::chunk_renderer(mogl::program program, job_system &jobs)
+    : queue{ jobs }, shader_program{ std::move(program) } {
   update_ogl_ids();
+  quad_indices.data(make_quad_indices(max_section_quads));
+}
+
+void chunk_renderer::set_mesh_mode(const mesh_mode m) {
+  queue.set_mesh_mode(m);
 }
 
 void chunk_renderer::set_program(mogl::program program) {
@@ -56,140 +64,121 @@ void chunk_renderer::render(const camera &cam) {
                                   cam.get_view_projection()));
   CHECKED_CALL(glUniformMatrix4fv(view_matrix_uniform_id, 1, GL_FALSE,
                                   cam.get_view_matrix()));
-  for (const auto &itr : meshes) {
-    const auto &pos = itr.first;
-    const auto &mesh = itr.second;
-    // Set the chunk position
-    const auto chunk_x = std::get<0>(pos);
-    const auto chunk_y = std::get<1>(pos);
-    const auto chunk_z = std::get<2>(pos);
-    const auto world_chunk_x = chunk_x * chunk_width;
-    const auto world_chunk_y = chunk_y * chunk_height;
-    const auto world_chunk_z = chunk_z * chunk_depth;
-    const auto world_center_chunk_x = world_chunk_x + half_chunk_width;
-    const auto world_center_chunk_y = world_chunk_y + half_chunk_height;
-    const auto world_center_chunk_z = world_chunk_z + half_chunk_depth;
-    const auto chunk_clip_position =
-        cam.world_to_clip(std::array<decltype(world_center_chunk_x), 3>{
-          { world_center_chunk_x, world_center_chunk_y, world_center_chunk_z }
-        });
-    const auto chunk_diameter_clip =
-        (float)chunk_diameter / std::abs(chunk_clip_position[3]);
-    // if the chunk is outside of the frustrum, don't draw it
-    if ((chunk_clip_position[2] < -chunk_diameter) ||
-        (std::fabs(chunk_clip_position[0]) > 3 + chunk_diameter_clip ||
-         std::fabs(chunk_clip_position[1]) > 3 + chunk_diameter_clip)) {
+  // Chunks hidden behind rock are never reached from the camera chunk
+  const auto eye = cam.get_position();
+  const chunk_key camera_key{
+    floor_div(static_cast<world_size_t>(std::floor(eye[0])), chunk_width),
+    floor_div(static_cast<world_size_t>(std::floor(eye[1])), chunk_height),
+    floor_div(static_cast<world_size_t>(std::floor(eye[2])), chunk_depth)
+  };
+  reachable.clear();
+  if (occlusion_culling && !meshes.empty()) {
+    auto lo = meshes.cbegin()->first;
+    auto hi = lo;
+    for (const auto &itr : meshes) {
+      const auto &k = itr.first;
+      lo = chunk_key{ std::min(std::get<0>(lo), std::get<0>(k)),
+                      std::min(std::get<1>(lo), std::get<1>(k)),
+                      std::min(std::get<2>(lo), std::get<2>(k)) };
+      hi = chunk_key{ std::max(std::get<0>(hi), std::get<0>(k)),
+                      std::max(std::get<1>(hi), std::get<1>(k)),
+                      std::max(std::get<2>(hi), std::get<2>(k)) };
+    }
+    visibility::find_reachable_chunks(
+        camera_key, lo, hi, [this](const chunk_key &k) {
+          const auto itr = meshes.find(k);
+          return itr == meshes.end() ? nullptr : &itr->second.connectivity;
+        }, reachable);
+  } else {
+    for (const auto &itr : meshes) {
+      reachable.push_back(itr.first);
+    }
+  }
+
+  // Boxes of the chunks that have something to draw, culled in one batch
+  boxes.half_extent = { { static_cast<float>(half_chunk_width),
+                          static_cast<float>(half_chunk_height),
+                          static_cast<float>(half_chunk_depth) } };
+  boxes.clear();
+  candidates.clear();
+  for (const auto &pos : reachable) {
+    const auto itr = meshes.find(pos);
+    // chunks without visible faces, e.g. all air, have nothing to draw
+    if (itr == meshes.end() || itr->second.number_of_vertices() == 0) {
       continue;
     }
+    boxes.push_back(std::get<0>(pos) * chunk_width + half_chunk_width,
+                    std::get<1>(pos) * chunk_height + half_chunk_height,
+                    std::get<2>(pos) * chunk_depth + half_chunk_depth);
+    candidates.push_back(static_cast<std::uint32_t>(itr - meshes.begin()));
+  }
+  build_draw_list(frustum{ cam.get_view_projection() }, boxes, draw_list);
 
-    // Update the world_chunk position
+  for (const auto i : draw_list) {
+    const auto &itr = *(meshes.cbegin() + candidates[i]);
+    const auto &pos = itr.first;
+    const auto &mesh = itr.second;
+    // Set the chunk position
+    const auto world_chunk_x = std::get<0>(pos) * chunk_width;
+    const auto world_chunk_y = std::get<1>(pos) * chunk_height;
+    const auto world_chunk_z = std::get<2>(pos) * chunk_depth;
     CHECKED_CALL(glUniform3f(chunk_pos_uniform_id, world_chunk_x, world_chunk_y,
                              world_chunk_z));
-    mesh.vao.draw_arrays(mogl::draw_mode::triangles, 0,
-                         mesh.number_of_vertices);
+    for (const auto &section : mesh.sections) {
+      if (section.number_of_vertices != 0) {
+        section.vao.bind();
+        const auto quads = section.number_of_vertices / vertices_per_quad;
+        CHECKED_CALL(glDrawElements(GL_TRIANGLES, quads * indices_per_quad,
+                                    GL_UNSIGNED_SHORT, nullptr));
+      }
+    }
   }
 }
 
-void chunk_renderer::on_chunk_update(const chunk_key &key, const chunk &c) {
-  auto &mesh = meshes[key];
-  build_mesh(mesh, c);
+bool chunk_renderer::on_chunk_update(const chunk_key &key, const chunk &c,
+                                     const section_mask sections,
+                                     const unsigned level) {
+  return queue.request(key, c, sections, level);
 }
 
-void chunk_renderer::on_chunk_insertion(const chunk_key &key, const chunk &c) {
-  chunk_mesh m{};
-  build_mesh(m, c);
-  meshes.insert(std::make_pair(key, std::move(m)));
+bool chunk_renderer::on_chunk_insertion(const chunk_key &key, const chunk &c,
+                                        const unsigned level) {
+  return queue.request(key, c, chunk::all_sections, level);
 }
 
 void chunk_renderer::on_chunk_removal(const chunk_key &key) {
-  if (auto itr = meshes.find(key) != meshes.end()) {
+  queue.cancel(key);
+  const auto itr = meshes.find(key);
+  if (itr != meshes.end()) {
     meshes.erase(itr);
   }
 }
 
-void chunk_renderer::build_mesh(chunk_mesh &mesh, const chunk &c) {
-  // build the most naive mesh possible
-  buffer_data mesh_data;
-
-  // for each voxel in chunk c
-  // generate triangles for each face and stuff it in the appropriate
-  // buffer_data
-  // then upload completed buffers to the correct vbos
-  // TODO(co): the chunk should really expose an iterator that we use to iterate
-  // through the voxels. If our underlying chunk uses a map to store voxel
-  // information
-  // then this is one dumb tripple loop
-  for (auto z = 0; z < chunk::depth; ++z) {
-    for (auto y = 0; y < chunk::height; ++y) {
-      for (auto x = 0; x < chunk::width; ++x) {
-        const auto t = c.get(x, y, z);
-        if (t == block_type::air) {
-          continue;
-        }
-        if (c.is_face_visible<face::front>(x, y, z)) {
-          mesh_data.emplace_back(x, y + 1, z, t);
-          mesh_data.emplace_back(x, y, z, t);
-          mesh_data.emplace_back(x + 1, y, z, t);
-
-          mesh_data.emplace_back(x + 1, y, z, t);
-          mesh_data.emplace_back(x + 1, y + 1, z, t);
-          mesh_data.emplace_back(x, y + 1, z, t);
-        }
-        if (c.is_face_visible<face::back>(x, y, z)) {
-          mesh_data.emplace_back(x + 1, y + 1, z + 1, t);
-          mesh_data.emplace_back(x + 1, y, z + 1, t);
-          mesh_data.emplace_back(x, y, z + 1, t);
-
-          mesh_data.emplace_back(x, y, z + 1, t);
-          mesh_data.emplace_back(x, y + 1, z + 1, t);
-          mesh_data.emplace_back(x + 1, y + 1, z + 1, t);
-        }
-        if (c.is_face_visible<face::left>(x, y, z)) {
-          mesh_data.emplace_back(x, y + 1, z + 1, t);
-          mesh_data.emplace_back(x, y, z + 1, t);
-          mesh_data.emplace_back(x, y, z, t);
-
-          mesh_data.emplace_back(x, y, z, t);
-          mesh_data.emplace_back(x, y + 1, z, t);
-          mesh_data.emplace_back(x, y + 1, z + 1, t);
-        }
-        if (c.is_face_visible<face::right>(x, y, z)) {
-          mesh_data.emplace_back(x + 1, y + 1, z, t);
-          mesh_data.emplace_back(x + 1, y, z, t);
-          mesh_data.emplace_back(x + 1, y, z + 1, t);
-
-          mesh_data.emplace_back(x + 1, y, z + 1, t);
-          mesh_data.emplace_back(x + 1, y + 1, z + 1, t);
-          mesh_data.emplace_back(x + 1, y + 1, z, t);
-        }
-        if (c.is_face_visible<face::top>(x, y, z)) {
-          mesh_data.emplace_back(x, y + 1, z + 1, t);
-          mesh_data.emplace_back(x, y + 1, z, t);
-          mesh_data.emplace_back(x + 1, y + 1, z, t);
-
-          mesh_data.emplace_back(x + 1, y + 1, z, t);
-          mesh_data.emplace_back(x + 1, y + 1, z + 1, t);
-          mesh_data.emplace_back(x, y + 1, z + 1, t);
-        }
-        if (c.is_face_visible<face::bottom>(x, y, z)) {
-          mesh_data.emplace_back(x, y, z, t);
-          mesh_data.emplace_back(x, y, z + 1, t);
-          mesh_data.emplace_back(x + 1, y, z + 1, t);
-
-          mesh_data.emplace_back(x + 1, y, z + 1, t);
-          mesh_data.emplace_back(x + 1, y, z, t);
-          mesh_data.emplace_back(x, y, z, t);
-        }
-      }
-    }
-  }
+std::size_t chunk_renderer::upload_meshes(const std::size_t max_uploads) {
+  return queue.drain(max_uploads, [this](
+      const chunk_key &key, const std::size_t section, const buffer_data &data,
+      const chunk_connectivity &connectivity) {
+    auto &mesh = meshes[key];
+    mesh.connectivity = connectivity;
+    upload_mesh(mesh.sections[section], data);
+  });
+}
 
-  // upload data to buffers
+void chunk_renderer::upload_mesh(section_mesh &mesh,
+                                 const buffer_data &mesh_data) {
   mesh.number_of_vertices = mesh_data.size();
+  // render skips meshes without vertices, their buffers are never bound
+  if (mesh_data.empty()) {
+    return;
+  }
+  assert(mesh_data.size() <= max_section_quads * vertices_per_quad);
   mesh.vbo.data(mesh_data);
   mesh.vao.vertex_attrib_pointer(mesh.vbo, cube_pos_attrib_id, 4,
                                  GL_UNSIGNED_BYTE, GL_FALSE, 0, 0);
   mesh.vao.enable_vertex_attrib_array(cube_pos_attrib_id);
+  // The element array binding is part of the vertex array state
+  mesh.vao.bind();
+  quad_indices.bind();
 }
 
 } // namespace lexov
@@ -1,37 +1,72 @@
 #pragma once
 #include "chunk.hpp"
 #include "chunk_mesh.hpp"
+#include "chunk_mesher.hpp"
+#include "flat_chunk_map.hpp"
+#include "frustum.hpp"
+#include "mesh_queue.hpp"
+#include "mesh_sink.hpp"
 #include "types.hpp"
 #include <mogl/mogl.hpp>
-#include <unordered_map>
 
 namespace lexov {
 class camera;
-class chunk_renderer {
+class job_system;
+class chunk_renderer : public mesh_sink {
 public:
-  chunk_renderer(mogl::program program);
+  chunk_renderer(mogl::program program, job_system &jobs);
   void render(const camera &cam);
-  void on_chunk_update(const chunk_key &key, const chunk &c);
-  void on_chunk_insertion(const chunk_key &key, const chunk &c);
-  void on_chunk_removal(const chunk_key &key);
+  // Queue a mesh build on the job system, see mesh_sink
+  bool on_chunk_update(const chunk_key &key, const chunk &c,
+                       const section_mask sections,
+                       const unsigned level = 0) override;
+  bool on_chunk_insertion(const chunk_key &key, const chunk &c,
+                          const unsigned level = 0) override;
+  void on_chunk_removal(const chunk_key &key) override;
+  // Uploads at most max_uploads finished meshes, must be called on the GL
+  // thread. Returns the number of uploaded meshes.
+  std::size_t upload_meshes(const std::size_t max_uploads = 16);
   void set_program(mogl::program program);
+  // Only affects meshes built after the call
+  void set_mesh_mode(const mesh_mode m);
+  // Skip chunks that can't be seen from the camera chunk through air, on by
+  // default
+  void set_occlusion_culling(const bool enabled) {
+    occlusion_culling = enabled;
+  }
+  // See mesh_queue::get_buffer_allocations
+  std::size_t get_mesh_buffer_allocations() const {
+    return queue.get_buffer_allocations();
+  }
+  // Chunks drawn by the last render
+  std::size_t get_number_of_drawn_chunks() const { return draw_list.size(); }
   std::size_t get_total_number_of_vertices() {
     std::size_t count = 0;
     for (const auto &mesh : meshes) {
       const auto &c = mesh.second;
-      count += c.number_of_vertices;
+      count += c.number_of_vertices();
     }
     return count;
   }
 private:
   void update_ogl_ids();
-  void build_mesh(chunk_mesh &mesh, const chunk &c);
-  using chunk_mesh_map =
-      std::unordered_map<chunk_key, chunk_mesh, chunk_hash, chunk_hash_equal>;
+  void upload_mesh(section_mesh &mesh, const buffer_data &mesh_data);
+  using chunk_mesh_map = flat_chunk_map<chunk_mesh>;
   chunk_mesh_map meshes;
+  bool occlusion_culling{ true };
+  // Per frame scratch of render: chunks reachable from the camera, their
+  // boxes, the meshes entry of each box and the boxes to draw
+  std::vector<chunk_key> reachable;
+  box_batch boxes;
+  std::vector<std::uint32_t> candidates;
+  std::vector<std::uint32_t> draw_list;
+  mesh_queue queue;
   mogl::program shader_program{};
   using texture_buffer_object = mogl::buffer<mogl::buffer_type::texture, mogl::buffer_usage::static_draw>;
   texture_buffer_object tbo{};
+  // Shared by all section meshes, see buffer_data
+  using index_buffer_object = mogl::buffer<mogl::buffer_type::element_array, mogl::buffer_usage::static_draw>;
+  index_buffer_object quad_indices{};
   mogl::texture<mogl::texture_type::texture_buffer> tbo_texture{};
 
   GLuint cube_pos_attrib_id;
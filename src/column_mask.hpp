@@ -0,0 +1,154 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace lexov {
+
+// Fixed size bitset with one bit per voxel of a vertical (x, z) column. Unlike
+// std::bitset it exposes shifts with a carry bit, popcount and set bit
+// iteration, which is what word parallel face culling needs.
+template <std::size_t Bits> class column_mask {
+public:
+  using word = std::uint64_t;
+  static constexpr std::size_t bits_per_word = 64;
+  static constexpr std::size_t words = (Bits + bits_per_word - 1) / bits_per_word;
+
+  // Mask with the bits [begin, end) set
+  static column_mask range(const std::size_t begin, const std::size_t end) {
+    column_mask result;
+    for (std::size_t i = 0; i < words; ++i) {
+      const auto lo = i * bits_per_word;
+      if (end <= lo || begin >= lo + bits_per_word) {
+        continue;
+      }
+      const auto b = begin > lo ? begin - lo : 0;
+      const auto e = end - lo < bits_per_word ? end - lo : bits_per_word;
+      const word upto = e == bits_per_word ? ~word{ 0 } : (word{ 1 } << e) - 1;
+      result.data[i] = upto & ~((word{ 1 } << b) - 1);
+    }
+    return result;
+  }
+
+  bool test(const std::size_t i) const {
+    return (data[i / bits_per_word] >> (i % bits_per_word)) & 1;
+  }
+
+  void set(const std::size_t i) {
+    data[i / bits_per_word] |= word{ 1 } << (i % bits_per_word);
+  }
+
+  void reset(const std::size_t i) {
+    data[i / bits_per_word] &= ~(word{ 1 } << (i % bits_per_word));
+  }
+
+  void set(const std::size_t i, const bool value) {
+    if (value) {
+      set(i);
+    } else {
+      reset(i);
+    }
+  }
+
+  std::size_t count() const {
+    std::size_t n = 0;
+    for (const auto w : data) {
+      n += __builtin_popcountll(w);
+    }
+    return n;
+  }
+
+  bool none() const {
+    for (const auto w : data) {
+      if (w) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Bit i of the result is bit i + 1 of this mask; the top bit is carry
+  column_mask shifted_down(const bool carry) const {
+    column_mask result;
+    for (std::size_t i = 0; i < words; ++i) {
+      const word next = i + 1 < words ? data[i + 1] : 0;
+      result.data[i] = (data[i] >> 1) | (next << (bits_per_word - 1));
+    }
+    result.set(Bits - 1, carry);
+    return result;
+  }
+
+  // Bit i of the result is bit i - 1 of this mask; the bottom bit is carry
+  column_mask shifted_up(const bool carry) const {
+    column_mask result;
+    for (std::size_t i = 0; i < words; ++i) {
+      const word prev = i > 0 ? data[i - 1] : 0;
+      result.data[i] = (data[i] << 1) | (prev >> (bits_per_word - 1));
+    }
+    result.set(0, carry);
+    result.clear_unused();
+    return result;
+  }
+
+  // this & ~other
+  column_mask and_not(const column_mask &other) const {
+    column_mask result;
+    for (std::size_t i = 0; i < words; ++i) {
+      result.data[i] = data[i] & ~other.data[i];
+    }
+    return result;
+  }
+
+  column_mask operator&(const column_mask &other) const {
+    column_mask result;
+    for (std::size_t i = 0; i < words; ++i) {
+      result.data[i] = data[i] & other.data[i];
+    }
+    return result;
+  }
+
+  column_mask operator|(const column_mask &other) const {
+    column_mask result;
+    for (std::size_t i = 0; i < words; ++i) {
+      result.data[i] = data[i] | other.data[i];
+    }
+    return result;
+  }
+
+  bool operator==(const column_mask &other) const { return data == other.data; }
+  bool operator!=(const column_mask &other) const { return data != other.data; }
+
+  // Calls f(i) for every set bit i in increasing order
+  template <class Function> void for_each_set_bit(const Function &f) const {
+    for (std::size_t i = 0; i < words; ++i) {
+      auto w = data[i];
+      while (w) {
+        f(i * bits_per_word + __builtin_ctzll(w));
+        w &= w - 1;
+      }
+    }
+  }
+
+private:
+  void clear_unused() {
+    if (Bits % bits_per_word) {
+      data[words - 1] &= (word{ 1 } << (Bits % bits_per_word)) - 1;
+    }
+  }
+
+  std::array<word, words> data{};
+};
+
+// Occupancy of one column: solid voxels emit faces, opaque voxels hide the
+// faces of their neighbors
+template <std::size_t Bits> struct column_occupancy {
+  column_mask<Bits> solid;
+  column_mask<Bits> opaque;
+
+  void set(const std::size_t i, const bool is_solid, const bool is_opaque) {
+    solid.set(i, is_solid);
+    opaque.set(i, is_opaque);
+  }
+};
+
+} // namespace lexov
@@ -0,0 +1,229 @@
+#pragma once
+#include "types.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace lexov {
+
+// Chunk coordinates packed into 21 bits per axis
+using packed_chunk_key = std::uint64_t;
+constexpr const unsigned chunk_key_bits = 21;
+constexpr const world_size_t max_chunk_coordinate =
+    (world_size_t{ 1 } << (chunk_key_bits - 1)) - 1;
+constexpr const world_size_t min_chunk_coordinate = -max_chunk_coordinate - 1;
+
+// Valid for chunk coordinates in [min_chunk_coordinate, max_chunk_coordinate]
+inline packed_chunk_key pack_chunk_key(const chunk_key &key) {
+  assert(std::get<0>(key) >= min_chunk_coordinate &&
+         std::get<0>(key) <= max_chunk_coordinate);
+  assert(std::get<1>(key) >= min_chunk_coordinate &&
+         std::get<1>(key) <= max_chunk_coordinate);
+  assert(std::get<2>(key) >= min_chunk_coordinate &&
+         std::get<2>(key) <= max_chunk_coordinate);
+  constexpr packed_chunk_key mask =
+      (packed_chunk_key{ 1 } << chunk_key_bits) - 1;
+  return (static_cast<packed_chunk_key>(std::get<0>(key)) & mask) |
+         (static_cast<packed_chunk_key>(std::get<1>(key)) & mask)
+             << chunk_key_bits |
+         (static_cast<packed_chunk_key>(std::get<2>(key)) & mask)
+             << (2 * chunk_key_bits);
+}
+
+// Hash table from chunk_key to T. The entries live in one vector, so
+// iteration is a linear scan. A separate open addressing table of (packed
+// key, entry index) slots with linear probing finds them; a lookup compares
+// packed keys only and touches a single entry.
+//
+// Insertions may reallocate the entries, erasing moves the last entry into
+// the hole. Either invalidates iterators and references, except that erase
+// returns an iterator to the entry that took the erased one's place.
+template <class T> class flat_chunk_map {
+public:
+  using value_type = std::pair<chunk_key, T>;
+  using iterator = typename std::vector<value_type>::iterator;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  iterator begin() { return entries.begin(); }
+  iterator end() { return entries.end(); }
+  const_iterator begin() const { return entries.begin(); }
+  const_iterator end() const { return entries.end(); }
+  const_iterator cbegin() const { return entries.cbegin(); }
+  const_iterator cend() const { return entries.cend(); }
+
+  std::size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+
+  void clear() {
+    entries.clear();
+    slots.assign(slots.size(), slot{ 0, empty_slot });
+  }
+
+  void reserve(const std::size_t count) {
+    entries.reserve(count);
+    if (count > max_load(slots.size())) {
+      rehash(count);
+    }
+  }
+
+  iterator find(const chunk_key &key) {
+    const auto s = find_slot(pack_chunk_key(key));
+    return s == npos ? end() : begin() + slots[s].index;
+  }
+
+  const_iterator find(const chunk_key &key) const {
+    const auto s = find_slot(pack_chunk_key(key));
+    return s == npos ? end() : begin() + slots[s].index;
+  }
+
+  std::size_t count(const chunk_key &key) const {
+    return find_slot(pack_chunk_key(key)) == npos ? 0 : 1;
+  }
+
+  std::pair<iterator, bool> insert(value_type value);
+
+  // Constructs the value from args only when key isn't in the map yet
+  template <class... Args>
+  std::pair<iterator, bool> try_emplace(const chunk_key &key, Args &&... args);
+
+  T &operator[](const chunk_key &key) { return try_emplace(key).first->second; }
+
+  std::size_t erase(const chunk_key &key) {
+    const auto itr = find(key);
+    if (itr == end()) {
+      return 0;
+    }
+    erase(itr);
+    return 1;
+  }
+
+  iterator erase(const_iterator pos);
+
+  // Bytes held by the entries and the slot table
+  std::size_t memory_usage() const {
+    return entries.capacity() * sizeof(value_type) +
+           slots.capacity() * sizeof(slot);
+  }
+
+private:
+  struct slot {
+    packed_chunk_key key;
+    std::uint32_t index;
+  };
+  static constexpr std::uint32_t empty_slot = 0xffffffff;
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  std::vector<value_type> entries;
+  // Power of two sized, at most 3/4 full
+  std::vector<slot> slots;
+
+  static std::size_t max_load(const std::size_t slot_count) {
+    return slot_count / 4 * 3;
+  }
+
+  // Murmur3 finalizer, neighboring chunks differ in a few low bits only
+  static std::size_t hash(packed_chunk_key k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return static_cast<std::size_t>(k);
+  }
+
+  std::size_t home_slot(const packed_chunk_key k) const {
+    return hash(k) & (slots.size() - 1);
+  }
+
+  std::size_t find_slot(const packed_chunk_key k) const {
+    if (slots.empty()) {
+      return npos;
+    }
+    const auto mask = slots.size() - 1;
+    for (auto s = home_slot(k);; s = (s + 1) & mask) {
+      if (slots[s].index == empty_slot) {
+        return npos;
+      }
+      if (slots[s].key == k) {
+        return s;
+      }
+    }
+  }
+
+  void place(const packed_chunk_key k, const std::uint32_t index) {
+    const auto mask = slots.size() - 1;
+    auto s = home_slot(k);
+    while (slots[s].index != empty_slot) {
+      s = (s + 1) & mask;
+    }
+    slots[s] = slot{ k, index };
+  }
+
+  void rehash(const std::size_t count) {
+    std::size_t slot_count = 16;
+    while (max_load(slot_count) < count) {
+      slot_count *= 2;
+    }
+    slots.assign(slot_count, slot{ 0, empty_slot });
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      place(pack_chunk_key(entries[i].first), static_cast<std::uint32_t>(i));
+    }
+  }
+
+  // Empties slot s and shifts the following probe run back over the hole
+  void erase_slot(std::size_t s) {
+    const auto mask = slots.size() - 1;
+    for (auto next = (s + 1) & mask; slots[next].index != empty_slot;
+         next = (next + 1) & mask) {
+      const auto home = home_slot(slots[next].key);
+      // move the slot back unless its home lies between the hole and it
+      if (((next - home) & mask) >= ((next - s) & mask)) {
+        slots[s] = slots[next];
+        s = next;
+      }
+    }
+    slots[s].index = empty_slot;
+  }
+};
+
+template <class T>
+auto flat_chunk_map<T>::insert(value_type value) -> std::pair<iterator, bool> {
+  return try_emplace(value.first, std::move(value.second));
+}
+
+template <class T>
+template <class... Args>
+auto flat_chunk_map<T>::try_emplace(const chunk_key &key, Args &&... args)
+    -> std::pair<iterator, bool> {
+  const auto k = pack_chunk_key(key);
+  const auto s = find_slot(k);
+  if (s != npos) {
+    return std::make_pair(begin() + slots[s].index, false);
+  }
+  if (entries.size() + 1 > max_load(slots.size())) {
+    rehash(entries.size() + 1);
+  }
+  place(k, static_cast<std::uint32_t>(entries.size()));
+  entries.emplace_back(std::piecewise_construct, std::forward_as_tuple(key),
+                       std::forward_as_tuple(std::forward<Args>(args)...));
+  return std::make_pair(end() - 1, true);
+}
+
+template <class T>
+auto flat_chunk_map<T>::erase(const_iterator pos) -> iterator {
+  const auto index = static_cast<std::size_t>(pos - cbegin());
+  erase_slot(find_slot(pack_chunk_key(pos->first)));
+  const auto last = entries.size() - 1;
+  if (index != last) {
+    entries[index] = std::move(entries[last]);
+    slots[find_slot(pack_chunk_key(entries[index].first))].index =
+        static_cast<std::uint32_t>(index);
+  }
+  entries.pop_back();
+  return begin() + index;
+}
+
+} // namespace lexov
@@ -0,0 +1,317 @@
+// Headless camera flight: streams and meshes the world along a camera path
+// at 60 ticks per second, like the game loop, and reports how well the
+// pipeline keeps up. Links only against the GL-free core library.
+//
+//   ./flight.bin [line|circle|<path file>] [seconds] [chunks per second]
+//                [load radius]
+//
+// A path file holds one "x y z" camera position in voxels per tick.
+#include "chunk.hpp"
+#include "chunk_manager.hpp"
+#include "flat_chunk_map.hpp"
+#include "frame_timing.hpp"
+#include "job_system.hpp"
+#include "mesh_queue.hpp"
+#include "mesh_sink.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+namespace {
+using namespace lexov;
+using flight_clock = std::chrono::steady_clock;
+using milliseconds = std::chrono::duration<double, std::milli>;
+constexpr int ticks_per_second = 60;
+
+void report(const std::string &name, const double value,
+            const std::string &unit) {
+  std::cout << name << ": " << value << " " << unit << std::endl;
+}
+
+// Reports the percentiles of samples, which it sorts
+void report_latencies(const std::string &name, std::vector<double> &samples) {
+  report(name + "/samples", samples.size(), "chunks");
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  const auto percentile = [&samples](const double p) {
+    return samples[static_cast<std::size_t>(p * (samples.size() - 1) + 0.5)];
+  };
+  report(name + "/p50", percentile(0.50), "ms");
+  report(name + "/p95", percentile(0.95), "ms");
+  report(name + "/p99", percentile(0.99), "ms");
+  report(name + "/max", samples.back(), "ms");
+}
+
+// Camera position in voxels at every tick, false once the path ends
+class camera_path {
+public:
+  explicit camera_path(const std::string &path, const double speed)
+      : name{ path } {
+    // a chunk layer above the middle of the world, where the rock floats
+    const double y = world_height * chunk_height * 0.6;
+    const double cx = world_width * chunk_width / 2.0;
+    const double cz = world_depth * chunk_depth / 2.0;
+    const double step = speed * chunk_width / ticks_per_second;
+    if (path == "line") {
+      position = [=](const std::size_t t, std::array<double, 3> &p) {
+        p = { { cx - world_width * chunk_width / 4.0 + step * t, y, cz } };
+        return true;
+      };
+    } else if (path == "circle") {
+      const double radius = world_width * chunk_width / 4.0;
+      position = [=](const std::size_t t, std::array<double, 3> &p) {
+        const double a = step * t / radius;
+        p = { { cx + radius * std::cos(a), y, cz + radius * std::sin(a) } };
+        return true;
+      };
+    } else {
+      std::ifstream in{ path };
+      if (!in) {
+        throw std::runtime_error{ "Failed to open path " + path };
+      }
+      // owned by the closure, so copies of the path stay valid
+      using positions = std::vector<std::array<double, 3>>;
+      const auto recorded = std::make_shared<positions>();
+      std::array<double, 3> p;
+      while (in >> p[0] >> p[1] >> p[2]) {
+        recorded->push_back(p);
+      }
+      position = [recorded](const std::size_t t, std::array<double, 3> &p) {
+        if (t >= recorded->size()) {
+          return false;
+        }
+        p = (*recorded)[t];
+        return true;
+      };
+    }
+  }
+
+  bool get(const std::size_t tick, std::array<double, 3> &p) const {
+    return position(tick, p);
+  }
+
+  const std::string name;
+
+private:
+  std::function<bool(std::size_t, std::array<double, 3> &)> position;
+};
+
+// Stands in for the chunk_renderer: meshes are built on the job system and
+// drained every tick, but never uploaded. Records when each chunk got its
+// first mesh.
+class headless_sink : public mesh_sink {
+public:
+  explicit headless_sink(job_system &jobs) : queue{ jobs } {}
+
+  bool on_chunk_update(const chunk_key &key, const chunk &c,
+                       const section_mask sections,
+                       const unsigned level = 0) override {
+    return queue.request(key, c, sections, level);
+  }
+  bool on_chunk_insertion(const chunk_key &key, const chunk &c,
+                          const unsigned level = 0) override {
+    inserted.push_back(key);
+    return queue.request(key, c, chunk::all_sections, level);
+  }
+  void on_chunk_removal(const chunk_key &key) override { queue.cancel(key); }
+
+  // Drains like chunk_renderer::upload_meshes, f(key) is called for every
+  // chunk with a finished mesh
+  template <class Function>
+  void drain(const std::size_t max_meshes, const Function &f) {
+    section_meshes += queue.drain(max_meshes, [&](
+        const chunk_key &key, std::size_t, const buffer_data &mesh_data,
+        const chunk_connectivity &) {
+      vertices += mesh_data.size();
+      f(key);
+    });
+  }
+
+  mesh_queue queue;
+  // Chunks inserted since the caller last cleared it
+  std::vector<chunk_key> inserted;
+  std::size_t section_meshes{ 0 };
+  std::size_t vertices{ 0 };
+};
+
+// When a chunk in range came in range, and whether it was loaded and meshed
+// since
+struct chunk_progress {
+  flight_clock::time_point in_range;
+  bool loaded;
+  bool meshed;
+};
+
+// Peak resident set size of the process in bytes
+double peak_memory() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return usage.ru_maxrss;
+#else
+  return usage.ru_maxrss * 1024.0;
+#endif
+}
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    const std::string path = argc > 1 ? argv[1] : "line";
+    const double duration = argc > 2 ? std::atof(argv[2]) : 20.0;
+    const double speed = argc > 3 ? std::atof(argv[3]) : 2.0;
+    streaming_settings settings;
+    if (argc > 4) {
+      settings.load_radius = std::atoi(argv[4]);
+      settings.unload_radius = settings.load_radius + 2;
+    }
+    const camera_path camera{ path, speed };
+
+    job_system jobs;
+    headless_sink sink{ jobs };
+    // the game's setup, see game::game
+    chunk_manager manager{ sink, jobs, chunk_storage::palette, settings };
+    std::cout << "path: " << camera.name << ", " << duration << " s at "
+              << speed << " chunks/s, load radius " << settings.load_radius
+              << ", workers: " << jobs.number_of_workers() << std::endl;
+
+    flat_chunk_map<chunk_progress> progress;
+    std::vector<double> load_latencies, mesh_latencies;
+    std::size_t loaded = 0, peak_chunks = 0, peak_pool_blocks = 0;
+    const auto ticks = static_cast<std::size_t>(duration * ticks_per_second);
+    const auto tick_length =
+        std::chrono::duration_cast<flight_clock::duration>(
+            std::chrono::duration<double>{ 1.0 / ticks_per_second });
+    const auto start = flight_clock::now();
+    std::array<double, 3> p, previous;
+    camera.get(0, previous);
+    std::size_t tick = 0;
+    for (; tick < ticks && camera.get(tick, p); ++tick) {
+      std::this_thread::sleep_until(start + tick * tick_length);
+      {
+        LEXOV_TIME_PHASE(frame_phase::frame);
+        const auto now = flight_clock::now();
+        std::array<float, 3> forward{ { static_cast<float>(p[0] - previous[0]),
+                                        0.0f,
+                                        static_cast<float>(p[2] -
+                                                           previous[2]) } };
+        if (forward[0] == 0.0f && forward[2] == 0.0f) {
+          forward[0] = 1.0f;
+        }
+        previous = p;
+        const auto x = static_cast<world_size_t>(std::floor(p[0]));
+        const auto y = static_cast<world_size_t>(std::floor(p[1]));
+        const auto z = static_cast<world_size_t>(std::floor(p[2]));
+
+        // the chunks the manager should load, as chunk_manager::is_in_range
+        const chunk_key center{ floor_div(x, chunk_width),
+                                floor_div(y, chunk_height),
+                                floor_div(z, chunk_depth) };
+        const auto r = settings.load_radius;
+        const auto vr = settings.vertical_radius;
+        for (world_size_t dz = -r; dz <= r; ++dz) {
+          for (world_size_t dx = -r; dx <= r; ++dx) {
+            if (dx * dx + dz * dz > r * r) {
+              continue;
+            }
+            for (world_size_t dy = -vr; dy <= vr; ++dy) {
+              const chunk_key key{ std::get<0>(center) + dx,
+                                   std::get<1>(center) + dy,
+                                   std::get<2>(center) + dz };
+              if (progress.find(key) == progress.end()) {
+                progress[key] = chunk_progress{ now, false, false };
+              }
+            }
+          }
+        }
+        for (auto itr = progress.begin(); itr != progress.end();) {
+          const auto dx = std::get<0>(itr->first) - std::get<0>(center);
+          const auto dy = std::get<1>(itr->first) - std::get<1>(center);
+          const auto dz = std::get<2>(itr->first) - std::get<2>(center);
+          if (dx * dx + dz * dz > r * r || std::abs(dy) > vr) {
+            itr = progress.erase(itr);
+          } else {
+            ++itr;
+          }
+        }
+
+        {
+          LEXOV_TIME_PHASE(frame_phase::update);
+          manager.update(x, y, z, forward);
+        }
+        for (const auto &key : sink.inserted) {
+          ++loaded;
+          const auto itr = progress.find(key);
+          if (itr != progress.end() && !itr->second.loaded) {
+            itr->second.loaded = true;
+            load_latencies.push_back(
+                milliseconds{ now - itr->second.in_range }.count());
+          }
+        }
+        sink.inserted.clear();
+        {
+          LEXOV_TIME_PHASE(frame_phase::upload);
+          sink.drain(16, [&](const chunk_key &key) {
+            const auto itr = progress.find(key);
+            if (itr != progress.end() && itr->second.loaded &&
+                !itr->second.meshed) {
+              itr->second.meshed = true;
+              mesh_latencies.push_back(
+                  milliseconds{ flight_clock::now() - itr->second.in_range }
+                      .count());
+            }
+          });
+        }
+        peak_chunks = std::max(peak_chunks,
+                               manager.get_number_of_loaded_chunks());
+        peak_pool_blocks = std::max(peak_pool_blocks,
+                                    chunk_pool().get_statistics().live_blocks);
+      }
+#if LEXOV_FRAME_TIMING
+      frame_timings().end_frame();
+#endif
+    }
+    const double flown = static_cast<double>(tick) / ticks_per_second;
+    const double wall =
+        std::chrono::duration<double>{ flight_clock::now() - start }.count();
+    std::size_t pending = 0;
+    for (const auto &itr : progress) {
+      pending += !itr.second.meshed;
+    }
+
+    report("flight/simulated", flown, "s");
+    report("flight/wall", wall, "s");
+    report_latencies("flight/in_range_to_loaded", load_latencies);
+    report_latencies("flight/in_range_to_mesh_ready", mesh_latencies);
+    report("flight/not_ready_at_end", pending, "chunks in range");
+    report("flight/throughput/chunks", loaded / flown, "chunks/s");
+    report("flight/throughput/section_meshes", sink.section_meshes / flown,
+           "meshes/s");
+    report("flight/throughput/vertices", sink.vertices / flown, "vertices/s");
+    report("flight/peak/loaded_chunks", peak_chunks, "chunks");
+    report("flight/peak/pool_blocks", peak_pool_blocks, "blocks");
+    report("flight/peak/memory", peak_memory() / (1024.0 * 1024.0), "MiB");
+#if LEXOV_FRAME_TIMING
+    // generation and meshing as timed on the workers, the tick phases on
+    // this thread
+    frame_timings().write_csv(std::cout);
+#endif
+  }
+  catch (std::runtime_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,118 @@
+#include "frame_timing.hpp"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace lexov {
+
+const char *phase_name(const frame_phase p) {
+  static const char *names[] = { "frame",     "pre_update",   "update",
+                                 "streaming", "dirty_chunks", "generation",
+                                 "meshing",   "upload",       "draw" };
+  static_assert(sizeof(names) / sizeof(names[0]) ==
+                    static_cast<std::size_t>(frame_phase::count),
+                "a name per phase");
+  return names[static_cast<std::size_t>(p)];
+}
+
+phase_summary phase_histogram::summarize() const {
+  const auto recorded = next.load(std::memory_order_relaxed);
+  const auto n = static_cast<std::size_t>(
+      std::min<std::uint64_t>(recorded, history));
+  phase_summary s{ recorded, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  if (n == 0) {
+    return s;
+  }
+  std::vector<std::uint32_t> sorted(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    sorted[i] = samples[i].load(std::memory_order_relaxed);
+  }
+  std::sort(sorted.begin(), sorted.end());
+  const auto ms = [](const double ns) { return ns * 1e-6; };
+  // nearest rank
+  const auto percentile = [&](const double p) {
+    const auto rank = static_cast<std::size_t>(p * (n - 1) + 0.5);
+    return ms(sorted[rank]);
+  };
+  double total = 0.0;
+  for (const auto v : sorted) {
+    total += v;
+  }
+  s.mean = ms(total / n);
+  s.p50 = percentile(0.50);
+  s.p95 = percentile(0.95);
+  s.p99 = percentile(0.99);
+  s.max = ms(sorted.back());
+  return s;
+}
+
+void frame_timing::write_csv(std::ostream &out, const bool header) const {
+  if (header) {
+    out << "frame,phase,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+  }
+  for (std::size_t i = 0; i < histograms.size(); ++i) {
+    const auto p = static_cast<frame_phase>(i);
+    const auto s = summarize(p);
+    out << frames << ',' << phase_name(p) << ',' << s.samples << ','
+        << s.mean << ',' << s.p50 << ',' << s.p95 << ',' << s.p99 << ','
+        << s.max << '\n';
+  }
+}
+
+void frame_timing::write_json(std::ostream &out) const {
+  out << "{\"frame\":" << frames << ",\"phases\":{";
+  for (std::size_t i = 0; i < histograms.size(); ++i) {
+    const auto p = static_cast<frame_phase>(i);
+    const auto s = summarize(p);
+    out << (i > 0 ? "," : "") << '"' << phase_name(p) << "\":{\"samples\":"
+        << s.samples << ",\"mean_ms\":" << s.mean << ",\"p50_ms\":" << s.p50
+        << ",\"p95_ms\":" << s.p95 << ",\"p99_ms\":" << s.p99
+        << ",\"max_ms\":" << s.max << '}';
+  }
+  out << "}}\n";
+}
+
+void frame_timing::set_periodic_dump(const std::string &path,
+                                     const dump_format f,
+                                     const clock::duration period) {
+  dump.close();
+  dump_path = path;
+  format = f;
+  dump_period = period;
+  next_dump = clock::now() + period;
+}
+
+void frame_timing::end_frame() {
+  ++frames;
+  if (dump_period == clock::duration::zero()) {
+    return;
+  }
+  const auto now = clock::now();
+  if (now < next_dump) {
+    return;
+  }
+  next_dump = now + dump_period;
+  const bool first = !dump.is_open();
+  if (first) {
+    dump.open(dump_path, std::ios::trunc);
+    if (!dump) {
+      // timing must never take the game down, the dumps just stop
+      std::cerr << "Failed to open " << dump_path << std::endl;
+      dump_period = clock::duration::zero();
+      return;
+    }
+  }
+  if (format == dump_format::json) {
+    write_json(dump);
+  } else {
+    write_csv(dump, first);
+  }
+  dump.flush();
+}
+
+frame_timing &frame_timings() {
+  static frame_timing timings;
+  return timings;
+}
+
+} // namespace lexov
@@ -0,0 +1,131 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+// Frame timing is on unless compiled with -DLEXOV_FRAME_TIMING=0, which turns
+// LEXOV_TIME_PHASE into nothing
+#ifndef LEXOV_FRAME_TIMING
+#define LEXOV_FRAME_TIMING 1
+#endif
+
+#define LEXOV_TIMER_NAME_(line) lexov_phase_timer_##line
+#define LEXOV_TIMER_NAME(line) LEXOV_TIMER_NAME_(line)
+#if LEXOV_FRAME_TIMING
+// Times the rest of the enclosing scope as the given frame_phase
+#define LEXOV_TIME_PHASE(phase)                                                \
+  const ::lexov::scoped_phase_timer LEXOV_TIMER_NAME(__LINE__) { phase }
+#else
+#define LEXOV_TIME_PHASE(phase) static_cast<void>(0)
+#endif
+
+namespace lexov {
+
+// Where a frame's time goes. Phases may nest, draw includes upload and a
+// frame includes everything. generation and meshing run on the workers.
+enum class frame_phase : std::uint_least8_t {
+  frame, pre_update, update, streaming, dirty_chunks, generation, meshing,
+  upload, draw, count
+};
+const char *phase_name(const frame_phase p);
+
+// Percentiles over the samples still held by a phase_histogram, in
+// milliseconds
+struct phase_summary {
+  // Samples recorded in total, the percentiles only cover the last ones
+  std::uint64_t samples;
+  double mean;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+};
+
+// The last history durations of a phase in a ring buffer. record is lock
+// free and may be called from any thread, a sample costs two relaxed atomic
+// operations.
+class phase_histogram {
+public:
+  static constexpr std::size_t history = 1024;
+
+  void record(const std::chrono::nanoseconds d) {
+    const auto ns = d.count() < 0 ? 0 : d.count();
+    const auto i = next.fetch_add(1, std::memory_order_relaxed);
+    samples[i % history].store(
+        ns > UINT32_MAX ? UINT32_MAX : static_cast<std::uint32_t>(ns),
+        std::memory_order_relaxed);
+  }
+  phase_summary summarize() const;
+
+private:
+  // Nanoseconds, a sample saturates at about four seconds
+  std::array<std::atomic<std::uint32_t>, history> samples{};
+  std::atomic<std::uint64_t> next{ 0 };
+};
+
+enum class dump_format : std::uint_least8_t {
+  csv, json
+};
+
+// Histograms of every frame_phase. The game loop calls end_frame once per
+// frame, which writes a dump to a file when one is due.
+class frame_timing {
+public:
+  using clock = std::chrono::steady_clock;
+
+  void record(const frame_phase p, const clock::duration d) {
+    histograms[static_cast<std::size_t>(p)].record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(d));
+  }
+  phase_summary summarize(const frame_phase p) const {
+    return histograms[static_cast<std::size_t>(p)].summarize();
+  }
+  std::uint64_t get_frames() const { return frames; }
+
+  // A header line and one line per phase, each starting with the frame
+  void write_csv(std::ostream &out, const bool header = true) const;
+  // One object on a single line, so that dumps append as JSON lines
+  void write_json(std::ostream &out) const;
+
+  // Appends a dump to path every period, the file is truncated by the first
+  // one. A zero period stops the dumps.
+  void set_periodic_dump(const std::string &path, const dump_format format,
+                         const clock::duration period);
+  // Must be called from one thread only, the game loop's
+  void end_frame();
+
+private:
+  std::array<phase_histogram, static_cast<std::size_t>(frame_phase::count)>
+  histograms;
+  std::uint64_t frames{ 0 };
+  std::string dump_path;
+  dump_format format{ dump_format::csv };
+  clock::duration dump_period{ clock::duration::zero() };
+  clock::time_point next_dump;
+  std::ofstream dump;
+};
+
+// Timings of the running game, shared by every subsystem
+frame_timing &frame_timings();
+
+class scoped_phase_timer {
+public:
+  explicit scoped_phase_timer(const frame_phase p)
+      : phase{ p }, start{ frame_timing::clock::now() } {}
+  ~scoped_phase_timer() {
+    frame_timings().record(phase, frame_timing::clock::now() - start);
+  }
+  scoped_phase_timer(const scoped_phase_timer &) = delete;
+  scoped_phase_timer &operator=(const scoped_phase_timer &) = delete;
+
+private:
+  const frame_phase phase;
+  const frame_timing::clock::time_point start;
+};
+
+} // namespace lexov
@@ -0,0 +1,141 @@
+#include "frustum.hpp"
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+using lexov::frustum;
+
+// Distance of the corner of the box that lies furthest along the plane
+// normal; the box is outside when it is negative
+float max_distance(const frustum::plane &p, const float x, const float y,
+                   const float z, const std::array<float, 3> &h) {
+  return p[0] * x + p[1] * y + p[2] * z + p[3] + std::fabs(p[0]) * h[0] +
+         std::fabs(p[1]) * h[1] + std::fabs(p[2]) * h[2];
+}
+
+#if defined(__AVX2__)
+struct vector_ops {
+  using vf = __m256;
+  static constexpr std::size_t width = 8;
+  static const char *name() { return "avx2"; }
+  static vf load(const float *p) { return _mm256_loadu_ps(p); }
+  static vf set1(const float a) { return _mm256_set1_ps(a); }
+  static vf add(const vf a, const vf b) { return _mm256_add_ps(a, b); }
+  static vf mul(const vf a, const vf b) { return _mm256_mul_ps(a, b); }
+  static vf ge(const vf a, const vf b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  static vf bit_and(const vf a, const vf b) { return _mm256_and_ps(a, b); }
+  static unsigned movemask(const vf a) { return _mm256_movemask_ps(a); }
+};
+#elif defined(__SSE2__)
+struct vector_ops {
+  using vf = __m128;
+  static constexpr std::size_t width = 4;
+  static const char *name() { return "sse2"; }
+  static vf load(const float *p) { return _mm_loadu_ps(p); }
+  static vf set1(const float a) { return _mm_set1_ps(a); }
+  static vf add(const vf a, const vf b) { return _mm_add_ps(a, b); }
+  static vf mul(const vf a, const vf b) { return _mm_mul_ps(a, b); }
+  static vf ge(const vf a, const vf b) { return _mm_cmpge_ps(a, b); }
+  static vf bit_and(const vf a, const vf b) { return _mm_and_ps(a, b); }
+  static unsigned movemask(const vf a) { return _mm_movemask_ps(a); }
+};
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// Bit i is set when box first + i is inside all six planes. The box extent
+// term of each plane is the same for every box and folded into d.
+template <class V>
+unsigned test_batch(const std::array<frustum::plane, 6> &planes,
+                    const std::array<float, 6> &d, const float *x,
+                    const float *y, const float *z) {
+  const auto cx = V::load(x);
+  const auto cy = V::load(y);
+  const auto cz = V::load(z);
+  const auto zero = V::set1(0.0f);
+  auto inside = V::ge(zero, zero);
+  for (std::size_t i = 0; i < planes.size(); ++i) {
+    const auto distance =
+        V::add(V::add(V::mul(V::set1(planes[i][0]), cx),
+                      V::mul(V::set1(planes[i][1]), cy)),
+               V::add(V::mul(V::set1(planes[i][2]), cz), V::set1(d[i])));
+    inside = V::bit_and(inside, V::ge(distance, zero));
+  }
+  return V::movemask(inside);
+}
+#endif
+}
+
+namespace lexov {
+
+frustum::frustum(const float *m) {
+  // Gribb and Hartmann: the planes are sums and differences of the fourth
+  // row with the other rows of the matrix
+  const auto row = [m](const int r, const int c) { return m[c * 4 + r]; };
+  for (int axis = 0; axis < 3; ++axis) {
+    for (int c = 0; c < 4; ++c) {
+      planes[2 * axis][c] = row(3, c) + row(axis, c);
+      planes[2 * axis + 1][c] = row(3, c) - row(axis, c);
+    }
+  }
+  for (auto &p : planes) {
+    const auto length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    for (auto &v : p) {
+      v /= length;
+    }
+  }
+}
+
+bool frustum::intersects(const std::array<float, 3> &center,
+                         const std::array<float, 3> &half_extent) const {
+  for (const auto &p : planes) {
+    if (max_distance(p, center[0], center[1], center[2], half_extent) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void build_draw_list(const frustum &f, const box_batch &boxes,
+                     std::vector<std::uint32_t> &draw_list) {
+  draw_list.clear();
+  const auto &planes = f.get_planes();
+  std::size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+  using V = vector_ops;
+  std::array<float, 6> d;
+  for (std::size_t p = 0; p < planes.size(); ++p) {
+    d[p] = max_distance(planes[p], 0.0f, 0.0f, 0.0f, boxes.half_extent);
+  }
+  for (; i + V::width <= boxes.size(); i += V::width) {
+    auto inside =
+        test_batch<V>(planes, d, boxes.center_x.data() + i,
+                      boxes.center_y.data() + i, boxes.center_z.data() + i);
+    while (inside) {
+      draw_list.push_back(static_cast<std::uint32_t>(i) +
+                          __builtin_ctz(inside));
+      inside &= inside - 1;
+    }
+  }
+#endif
+  for (; i < boxes.size(); ++i) {
+    if (f.intersects({ { boxes.center_x[i], boxes.center_y[i],
+                         boxes.center_z[i] } },
+                     boxes.half_extent)) {
+      draw_list.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+const char *culling_instruction_set() {
+#if defined(__AVX2__) || defined(__SSE2__)
+  return vector_ops::name();
+#else
+  return "scalar";
+#endif
+}
+
+} // namespace lexov
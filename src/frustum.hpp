@@ -0,0 +1,60 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lexov {
+
+// View frustum as six planes a x + b y + c z + d >= 0, normals pointing
+// inwards and normalized
+class frustum {
+public:
+  using plane = std::array<float, 4>;
+
+  // Extracts the planes from a column major view projection matrix with
+  // OpenGL clip space, e.g. camera::get_view_projection
+  explicit frustum(const float *view_projection);
+
+  const std::array<plane, 6> &get_planes() const { return planes; }
+
+  // Axis aligned box given by its center and half extents
+  bool intersects(const std::array<float, 3> &center,
+                  const std::array<float, 3> &half_extent) const;
+
+private:
+  std::array<plane, 6> planes;
+};
+
+// Boxes of equal size in structure of arrays layout, so that a batch of them
+// is tested against a plane with a few vector instructions
+struct box_batch {
+  std::array<float, 3> half_extent;
+  std::vector<float> center_x;
+  std::vector<float> center_y;
+  std::vector<float> center_z;
+
+  std::size_t size() const { return center_x.size(); }
+  void clear() {
+    center_x.clear();
+    center_y.clear();
+    center_z.clear();
+  }
+  void push_back(const float x, const float y, const float z) {
+    center_x.push_back(x);
+    center_y.push_back(y);
+    center_z.push_back(z);
+  }
+};
+
+// Replaces draw_list with the indices of the boxes that intersect f, in
+// increasing order. Pure and GL free, the renderer draws the chunks it
+// returns. Conservative like frustum::intersects: boxes near a frustum
+// corner may be kept although they are outside.
+void build_draw_list(const frustum &f, const box_batch &boxes,
+                     std::vector<std::uint32_t> &draw_list);
+
+// "avx2", "sse2" or "scalar", see noise::instruction_set
+const char *culling_instruction_set();
+
+} // namespace lexov
@@ -1,4 +1,5 @@
 #include "game.hpp"
+#include "frame_timing.hpp"
 
 void fixed_timestep_game::load_content() {}
 
@@ -18,18 +19,32 @@ void fixed_timestep_game::loop() {
   constexpr auto dt = delta_time{ 1 };
   auto previous_time = clock::now();
   delta_time accumulator{ 0 };
+  using lexov::frame_phase;
   while (!should_quit()) {
-    const auto current_time = clock::now();
-    const auto frame_time = current_time - previous_time;
-    previous_time = current_time;
-    accumulator += frame_time;
-    pre_update(dt);
-    while (accumulator > dt) {
-      update(dt);
-      accumulator -= dt;
+    {
+      LEXOV_TIME_PHASE(frame_phase::frame);
+      const auto current_time = clock::now();
+      const auto frame_time = current_time - previous_time;
+      previous_time = current_time;
+      accumulator += frame_time;
+      {
+        LEXOV_TIME_PHASE(frame_phase::pre_update);
+        pre_update(dt);
+      }
+      while (accumulator > dt) {
+        LEXOV_TIME_PHASE(frame_phase::update);
+        update(dt);
+        accumulator -= dt;
+      }
+      const auto alpha = accumulator / dt;
+      post_update(alpha);
+      {
+        LEXOV_TIME_PHASE(frame_phase::draw);
+        draw();
+      }
     }
-    const auto alpha = accumulator / dt;
-    post_update(alpha);
-    draw();
+#if LEXOV_FRAME_TIMING
+    lexov::frame_timings().end_frame();
+#endif
   }
 }
@@ -0,0 +1,146 @@
+#include "job_system.hpp"
+#include <algorithm>
+
+namespace {
+// index of the worker running on this thread, or none
+constexpr std::size_t no_worker = static_cast<std::size_t>(-1);
+thread_local const lexov::job_system *current_system = nullptr;
+thread_local std::size_t current_worker = no_worker;
+}
+
+namespace lexov {
+
+job_system::job_system(const std::size_t number_of_workers) {
+  const auto count = std::max<std::size_t>(number_of_workers, 1);
+  for (std::size_t i = 0; i < count; ++i) {
+    workers.emplace_back(new worker{});
+  }
+  // start the threads only after every worker exists, they steal from each
+  // other
+  for (std::size_t i = 0; i < count; ++i) {
+    workers[i]->thread = std::thread{ &job_system::run, this, i };
+  }
+}
+
+job_system::~job_system() {
+  {
+    std::lock_guard<std::mutex> lock{ sleep_mutex };
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &w : workers) {
+    w->thread.join();
+  }
+}
+
+std::size_t job_system::default_worker_count() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void job_system::submit_detached(job j, const job_priority priority) {
+  const auto index = current_system == this
+                         ? current_worker
+                         : next_worker++ % workers.size();
+  auto &w = *workers[index];
+  {
+    std::lock_guard<std::mutex> lock{ w.mutex };
+    w.queues[static_cast<std::size_t>(priority)].push_back(std::move(j));
+  }
+  {
+    std::lock_guard<std::mutex> lock{ sleep_mutex };
+    ++queued;
+    ++unfinished;
+  }
+  wake.notify_one();
+}
+
+void job_system::wait_idle() {
+  std::unique_lock<std::mutex> lock{ sleep_mutex };
+  idle.wait(lock, [this]() { return unfinished == 0; });
+}
+
+bool job_system::try_pop(const std::size_t index, job &out, bool &stolen) {
+  for (std::size_t p = 0; p < static_cast<std::size_t>(job_priority::count);
+       ++p) {
+    {
+      auto &own = *workers[index];
+      std::lock_guard<std::mutex> lock{ own.mutex };
+      if (!own.queues[p].empty()) {
+        out = std::move(own.queues[p].front());
+        own.queues[p].pop_front();
+        stolen = false;
+        return true;
+      }
+    }
+    for (std::size_t offset = 1; offset < workers.size(); ++offset) {
+      auto &victim = *workers[(index + offset) % workers.size()];
+      std::lock_guard<std::mutex> lock{ victim.mutex };
+      if (!victim.queues[p].empty()) {
+        out = std::move(victim.queues[p].back());
+        victim.queues[p].pop_back();
+        stolen = true;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void job_system::execute(worker &w, job &j, const bool stolen) {
+  const auto begin = clock::now();
+  j();
+  const auto elapsed = clock::now() - begin;
+  w.busy_nanoseconds +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  ++w.jobs_executed;
+  if (stolen) {
+    ++w.jobs_stolen;
+  }
+  bool now_idle = false;
+  {
+    std::lock_guard<std::mutex> lock{ sleep_mutex };
+    now_idle = --unfinished == 0;
+  }
+  if (now_idle) {
+    idle.notify_all();
+  }
+}
+
+void job_system::run(const std::size_t index) {
+  current_system = this;
+  current_worker = index;
+  auto &w = *workers[index];
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock{ sleep_mutex };
+      wake.wait(lock, [this]() { return queued > 0 || stopping; });
+      if (queued == 0 && stopping) {
+        return;
+      }
+      // claim one job; some deque holds at least one unclaimed job
+      --queued;
+    }
+    job j;
+    bool stolen = false;
+    while (!try_pop(index, j, stolen)) {
+      // the claimed job is still being pushed by submit_detached
+      std::this_thread::yield();
+    }
+    execute(w, j, stolen);
+  }
+}
+
+auto job_system::get_statistics() const -> std::vector<worker_statistics> {
+  const auto lifetime =
+      std::chrono::duration<double>(clock::now() - start_time).count();
+  std::vector<worker_statistics> statistics;
+  for (const auto &w : workers) {
+    const auto busy = w->busy_nanoseconds * 1e-9;
+    statistics.push_back(worker_statistics{
+      w->jobs_executed, w->jobs_stolen, busy,
+      lifetime > 0.0 ? busy / lifetime : 0.0 });
+  }
+  return statistics;
+}
+
+} // namespace lexov
@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lexov {
+
+enum class job_priority : std::uint_least8_t {
+  high, normal, low, count
+};
+
+// Fixed pool of worker threads, sized to the hardware concurrency by default.
+// Every worker owns one deque per priority. Jobs submitted from a worker go to
+// its own deques, other submissions are spread round-robin. An idle worker
+// takes the highest priority job it can find, from its own deques first and
+// then by stealing from the back of the other workers' deques.
+class job_system {
+public:
+  using clock = std::chrono::steady_clock;
+  using job = std::function<void()>;
+
+  struct worker_statistics {
+    std::size_t jobs_executed;
+    std::size_t jobs_stolen;
+    double busy_seconds;
+    // busy_seconds over the lifetime of the job system
+    double utilization;
+  };
+
+  explicit job_system(const std::size_t number_of_workers = default_worker_count());
+  ~job_system();
+  job_system(const job_system &) = delete;
+  job_system &operator=(const job_system &) = delete;
+
+  // Runs f on a worker and returns a future for its result
+  template <class Function>
+  auto submit(Function f, const job_priority priority = job_priority::normal)
+      -> std::future<decltype(f())>;
+
+  // Fire and forget variant of submit
+  void submit_detached(job j, const job_priority priority = job_priority::normal);
+
+  // Blocks until every submitted job finished. Must not be called from a job.
+  void wait_idle();
+
+  std::size_t number_of_workers() const { return workers.size(); }
+  std::vector<worker_statistics> get_statistics() const;
+
+  static std::size_t default_worker_count();
+
+private:
+  struct worker {
+    std::mutex mutex;
+    std::deque<job> queues[static_cast<std::size_t>(job_priority::count)];
+    std::atomic<std::size_t> jobs_executed{ 0 };
+    std::atomic<std::size_t> jobs_stolen{ 0 };
+    std::atomic<std::int64_t> busy_nanoseconds{ 0 };
+    std::thread thread;
+  };
+
+  void run(const std::size_t index);
+  bool try_pop(const std::size_t index, job &out, bool &stolen);
+  void execute(worker &w, job &j, const bool stolen);
+
+  std::vector<std::unique_ptr<worker>> workers;
+  std::atomic<std::size_t> next_worker{ 0 };
+  // jobs pushed but not yet taken by a worker, guarded by sleep_mutex
+  std::size_t queued{ 0 };
+  // jobs pushed but not yet finished, guarded by sleep_mutex
+  std::size_t unfinished{ 0 };
+  bool stopping{ false };
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  const clock::time_point start_time{ clock::now() };
+};
+
+template <class Function>
+auto job_system::submit(Function f, const job_priority priority)
+    -> std::future<decltype(f())> {
+  // std::function must be copyable, so the task is shared
+  auto task =
+      std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+  auto result = task->get_future();
+  submit_detached([task]() { (*task)(); }, priority);
+  return result;
+}
+
+} // namespace lexov
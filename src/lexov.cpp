@@ -1,6 +1,8 @@
 #include "lexov.hpp"
+#include "frame_timing.hpp"
 #include <mogl/mogl.hpp>
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <iostream>
 
 namespace lexov {
@@ -21,14 +23,29 @@ game::game(GLFWwindow &window) : window_{ window } {
   cp.zoom_rate = 0.5f;
   camera_ = std::unique_ptr<camera>{ new camera{ cp } };
 
+  // Generation and meshing run on a worker per hardware thread
+  jobs_ = std::unique_ptr<job_system>{ new job_system{} };
+
   // Set up opengl shader program for the renderer
   mogl::program p{ mogl::vertex_shader::from_file("chunk.vs"),
                    mogl::fragment_shader::from_file("chunk.fs") };
-  renderer_ =
-      std::unique_ptr<chunk_renderer>{ new chunk_renderer{ std::move(p) } };
+  renderer_ = std::unique_ptr<chunk_renderer>{ new chunk_renderer{
+    std::move(p), *jobs_ } };
+
 
-  // Initialize the chunk manager
-  manager_ = std::unique_ptr<chunk_manager>{ new chunk_manager{ *renderer_ } };
+  // Initialize the chunk manager, it streams chunks in around the camera. Most
+  // floating rock chunks are uniform air or stone so the palette backend keeps
+  // the loaded area small
+  manager_ = std::unique_ptr<chunk_manager>{ new chunk_manager{
+    *renderer_, *jobs_, chunk_storage::palette } };
+  // Chunks generated once are read back from region files on later runs
+  regions_ = std::unique_ptr<region_store>{ new region_store{ "world" } };
+  manager_->set_region_store(regions_.get());
+#if LEXOV_FRAME_TIMING
+  // where the frame time goes, see frame_phase
+  frame_timings().set_periodic_dump("frame_timing.csv", dump_format::csv,
+                                    std::chrono::seconds{ 10 });
+#endif
   glfwSetInputMode(&window_, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
   glfwSetCursorPos(&window_, window_height/2.0f, window_width/2.0f);
   glEnable (GL_BLEND);
@@ -40,11 +57,16 @@ void game::load_content() {}
 
 void game::update(const delta_time &) { 
   const auto pos = camera_->get_position();
-  manager_->update(pos[0], pos[1], pos[2]);
+  manager_->update(pos[0], pos[1], pos[2], camera_->get_forward());
 }
 
 void game::draw() {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // meshes are built on the workers, only their upload costs frame time
+  {
+    LEXOV_TIME_PHASE(frame_phase::upload);
+    renderer_->upload_meshes();
+  }
   renderer_->render(*camera_);
   glfwSwapBuffers(&window_);
 }
@@ -74,8 +96,36 @@ void game::pre_update(const delta_time &dt) {
     glfwSetWindowShouldClose(&window_, true);
   }
   if (glfwGetKey(&window_, GLFW_KEY_SPACE)) {
-    std::cout << "Total # of solid blocks: " << manager_->get_total_number_of_solid_blocks() << std::endl;
+    const auto statistics = manager_->get_statistics();
+    std::cout << "Total # of solid blocks: " << statistics.solid_blocks
+              << " (" << statistics.empty_chunks << " empty and "
+              << statistics.full_chunks << " full chunks)" << std::endl;
+    std::cout << "Skipped sections: " << statistics.hidden_sections << " of "
+              << statistics.sections << " ("
+              << 100.0 * statistics.hidden_sections /
+                     std::max<std::size_t>(statistics.sections, 1)
+              << " %)" << std::endl;
+    std::cout << "Loaded chunks: " << manager_->get_number_of_loaded_chunks()
+              << " (" << manager_->get_number_of_pending_chunks()
+              << " pending)" << std::endl;
     std::cout << "Total # of vertices: " << renderer_->get_total_number_of_vertices() << std::endl;
+    std::cout << "Chunks per level of detail:";
+    for (const auto n : statistics.lod_chunks) {
+      std::cout << " " << n;
+    }
+    std::cout << std::endl;
+    std::cout << "Drawn chunks: " << renderer_->get_number_of_drawn_chunks()
+              << std::endl;
+    const auto pool = chunk_pool().get_statistics();
+    std::cout << "Chunk pool: " << pool.heap_allocations
+              << " heap allocations, " << pool.reuses << " reuses, "
+              << pool.live_blocks << " live and " << pool.free_blocks
+              << " free blocks" << std::endl;
+    std::cout << "Mesh buffer allocations: "
+              << renderer_->get_mesh_buffer_allocations() << std::endl;
+#if LEXOV_FRAME_TIMING
+    frame_timings().write_csv(std::cout);
+#endif
   }
 
   if (glfwGetMouseButton(&window_, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
@@ -1,9 +1,11 @@
 #pragma once
 #include "game.hpp"
 #include "camera.hpp"
+#include "chunk_io.hpp"
 #include "chunk_generator.hpp"
 #include "chunk_manager.hpp"
 #include "chunk_renderer.hpp"
+#include "job_system.hpp"
 #include <memory>
 #include <GLFW/glfw3.h>
 
@@ -21,6 +23,9 @@ private:
   bool should_quit() override;
   GLFWwindow &window_;
   std::unique_ptr<camera> camera_;
+  // declared before jobs_, queued region writes finish before it goes away
+  std::unique_ptr<region_store> regions_;
+  std::unique_ptr<job_system> jobs_;
   std::unique_ptr<chunk_renderer> renderer_;
   std::unique_ptr<chunk_manager> manager_;
   int window_height;
@@ -0,0 +1,125 @@
+#include "mesh_queue.hpp"
+#include "frame_timing.hpp"
+#include "job_system.hpp"
+#include <memory>
+
+namespace lexov {
+
+mesh_queue::mesh_queue(job_system &jobs, const std::size_t capacity)
+    : jobs{ jobs }, capacity{ capacity } {}
+
+mesh_queue::~mesh_queue() {
+  std::unique_lock<std::mutex> lock{ finished_mutex };
+  built.wait(lock, [this]() { return building == 0; });
+}
+
+bool mesh_queue::request(const chunk_key &key, const chunk &c,
+                         const section_mask sections,
+                         const unsigned level) {
+  if (is_full()) {
+    return false;
+  }
+  const auto id = next_request_id++;
+  auto &ids = latest_requests[key];
+  for (std::size_t s = 0; s < chunk::sections; ++s) {
+    if (sections & chunk::section_bit(s)) {
+      ids[s] = id;
+    }
+  }
+  ++outstanding;
+  // Empty and buried sections are handed back without a mesh. Empty and
+  // full chunks without any other section need neither a snapshot nor a
+  // job, their connectivity is known.
+  const auto visible = sections & chunk_mesher::visible_sections(c);
+  skipped_sections += __builtin_popcount(sections & ~visible);
+  meshed_sections += __builtin_popcount(visible);
+  if (visible == 0 && (c.is_empty() || c.is_full())) {
+    const auto connectivity = c.is_empty() ? chunk_connectivity::all()
+                                           : chunk_connectivity::none();
+    std::lock_guard<std::mutex> lock{ finished_mutex };
+    finished.push_back(finished_mesh{ key, id, sections, {}, connectivity });
+    return true;
+  }
+  // The snapshot reads c and its neighbors, which only this thread mutates
+  auto snapshot = make_pooled<chunk_snapshot>();
+  snapshot->load(c);
+  {
+    std::lock_guard<std::mutex> lock{ finished_mutex };
+    ++building;
+  }
+  const auto m = mode;
+  // Meshing is short and its result is visible right away, so it goes ahead
+  // of chunk generation
+  jobs.submit_detached([this, key, id, sections, visible, m, level,
+                        snapshot]() {
+    LEXOV_TIME_PHASE(frame_phase::meshing);
+    finished_mesh result{ key, id, sections, {}, {} };
+    // large enough for any section, allocated once per worker
+    static thread_local buffer_data scratch;
+    if (scratch.capacity() == 0) {
+      scratch.reserve(max_section_quads * vertices_per_quad);
+      ++buffer_allocations;
+    }
+    for (std::size_t s = 0; s < chunk::sections; ++s) {
+      if (visible & chunk::section_bit(s)) {
+        scratch.clear();
+        chunk_mesher::build_section_mesh(scratch, *snapshot, m, s, level);
+        if (!scratch.empty()) {
+          result.mesh_data[s] = copy_to_spare(scratch);
+        }
+      }
+    }
+    result.connectivity = visibility::compute_connectivity(*snapshot);
+    std::lock_guard<std::mutex> lock{ finished_mutex };
+    finished.push_back(std::move(result));
+    --building;
+    // under the lock, the destructor may run as soon as it is released
+    built.notify_all();
+  }, job_priority::high);
+  return true;
+}
+
+void mesh_queue::cancel(const chunk_key &key) { latest_requests.erase(key); }
+
+buffer_data mesh_queue::copy_to_spare(const buffer_data &mesh_data) {
+  buffer_data buffer;
+  {
+    std::lock_guard<std::mutex> lock{ finished_mutex };
+    if (!spare_buffers.empty()) {
+      // the smallest buffer large enough, else the largest one, which gets
+      // grown
+      auto spare = spare_buffers.end() - 1;
+      for (auto b = spare_buffers.begin(); b != spare_buffers.end(); ++b) {
+        const bool fits = b->capacity() >= mesh_data.size();
+        const bool spare_fits = spare->capacity() >= mesh_data.size();
+        if (fits ? !spare_fits || b->capacity() < spare->capacity()
+                 : !spare_fits && b->capacity() > spare->capacity()) {
+          spare = b;
+        }
+      }
+      buffer.swap(*spare);
+      spare->swap(spare_buffers.back());
+      spare_buffers.pop_back();
+    }
+  }
+  if (buffer.capacity() < mesh_data.size()) {
+    ++buffer_allocations;
+  }
+  buffer.assign(mesh_data.begin(), mesh_data.end());
+  return buffer;
+}
+
+void mesh_queue::recycle(finished_mesh &m) {
+  std::lock_guard<std::mutex> lock{ finished_mutex };
+  for (auto &buffer : m.mesh_data) {
+    // more spares than sections in flight are never used
+    if (buffer.capacity() == 0 ||
+        spare_buffers.size() >= capacity * chunk::sections) {
+      continue;
+    }
+    buffer.clear();
+    spare_buffers.push_back(std::move(buffer));
+  }
+}
+
+} // namespace lexov
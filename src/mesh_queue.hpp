@@ -0,0 +1,150 @@
+#pragma once
+#include "chunk.hpp"
+#include "chunk_buffer.hpp"
+#include "chunk_mesher.hpp"
+#include "flat_chunk_map.hpp"
+#include "types.hpp"
+#include "visibility.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace lexov {
+
+class job_system;
+
+// Builds chunk meshes on the job system. request() snapshots the chunk and its
+// neighbors on the calling thread, the mesh is built from that immutable
+// snapshot on a worker. drain() hands the finished buffer_data back on the
+// owning thread, so only the GL upload happens there. Meshes are built per
+// chunk section, a request only rebuilds the sections it names. Every
+// request also recomputes the chunk_connectivity of the chunk.
+//
+// request, drain, cancel and the setters must all be called from the same
+// thread.
+class mesh_queue {
+public:
+  explicit mesh_queue(job_system &jobs, const std::size_t capacity = 64);
+  // Waits for the meshes still being built
+  ~mesh_queue();
+  mesh_queue(const mesh_queue &) = delete;
+  mesh_queue &operator=(const mesh_queue &) = delete;
+
+  // Queues a mesh build for the given sections of c at the given level of
+  // detail, see chunk_mesher::build_section_mesh. Returns false without
+  // queueing anything when capacity chunks are already being built or
+  // waiting to be drained, the caller should retry later.
+  bool request(const chunk_key &key, const chunk &c,
+               const section_mask sections = chunk::all_sections,
+               const unsigned level = 0);
+
+  // Results of earlier requests for key are dropped
+  void cancel(const chunk_key &key);
+
+  // Calls f(key, section, mesh_data, connectivity) for the section meshes of
+  // at most max_meshes finished requests, oldest first. Superseded and
+  // cancelled sections are skipped, requests with only empty meshes are
+  // handed to f but don't count. Returns the number of section meshes handed
+  // to f.
+  template <class Function>
+  std::size_t drain(const std::size_t max_meshes, const Function &f);
+
+  void set_mesh_mode(const mesh_mode m) { mode = m; }
+  void set_capacity(const std::size_t c) { capacity = c; }
+  // Meshes requested but not drained yet
+  std::size_t size() const { return outstanding; }
+  bool is_full() const { return outstanding >= capacity; }
+  // Requested sections that were meshed, and those skipped because they are
+  // empty or enclosed
+  std::size_t get_meshed_sections() const { return meshed_sections; }
+  std::size_t get_skipped_sections() const { return skipped_sections; }
+  // Mesh buffers that had to be allocated or grown. Meshes are built in a
+  // scratch buffer per worker and copied into a buffer recycled from an
+  // earlier drain, so this stops growing once the buffers are large enough.
+  std::size_t get_buffer_allocations() const { return buffer_allocations; }
+
+private:
+  struct finished_mesh {
+    chunk_key key;
+    std::uint64_t request_id;
+    section_mask sections;
+    std::array<buffer_data, chunk::sections> mesh_data;
+    chunk_connectivity connectivity;
+  };
+  // Latest request per section, 0 when none is outstanding
+  using section_requests = std::array<std::uint64_t, chunk::sections>;
+
+  job_system &jobs;
+  std::size_t capacity;
+  mesh_mode mode{ mesh_mode::greedy };
+  std::size_t outstanding{ 0 };
+  std::size_t meshed_sections{ 0 };
+  std::size_t skipped_sections{ 0 };
+  std::uint64_t next_request_id{ 1 };
+  // Anything older than the latest request of a section is stale
+  flat_chunk_map<section_requests> latest_requests;
+  // Written by the workers
+  std::mutex finished_mutex;
+  std::condition_variable built;
+  std::size_t building{ 0 };
+  std::deque<finished_mesh> finished;
+  // Buffers of drained meshes, handed to the next meshes built
+  std::vector<buffer_data> spare_buffers;
+  std::atomic<std::size_t> buffer_allocations{ 0 };
+
+  // Returns a spare buffer holding a copy of mesh_data
+  buffer_data copy_to_spare(const buffer_data &mesh_data);
+  // Moves the buffers of m to spare_buffers
+  void recycle(finished_mesh &m);
+};
+
+template <class Function>
+std::size_t mesh_queue::drain(const std::size_t max_meshes,
+                              const Function &f) {
+  std::size_t drained = 0;
+  std::size_t counted = 0;
+  while (counted < max_meshes) {
+    finished_mesh m;
+    {
+      std::lock_guard<std::mutex> lock{ finished_mutex };
+      if (finished.empty()) {
+        break;
+      }
+      m = std::move(finished.front());
+      finished.pop_front();
+    }
+    --outstanding;
+    const auto latest = latest_requests.find(m.key);
+    if (latest == latest_requests.end()) {
+      recycle(m);
+      continue;
+    }
+    auto &ids = latest->second;
+    bool pending = false;
+    bool uploads = false;
+    for (std::size_t s = 0; s < chunk::sections; ++s) {
+      if (!(m.sections & chunk::section_bit(s)) || ids[s] != m.request_id) {
+        pending = pending || ids[s] != 0;
+        continue;
+      }
+      ids[s] = 0;
+      f(m.key, s, m.mesh_data[s], m.connectivity);
+      ++drained;
+      uploads = uploads || !m.mesh_data[s].empty();
+    }
+    if (!pending) {
+      latest_requests.erase(latest);
+    }
+    if (uploads) {
+      ++counted;
+    }
+    recycle(m);
+  }
+  return drained;
+}
+
+} // namespace lexov
@@ -0,0 +1,24 @@
+#pragma once
+#include "chunk.hpp"
+#include "types.hpp"
+
+namespace lexov {
+
+// Receives the chunks the chunk_manager loads, changes and drops, and turns
+// them into meshes. chunk_renderer uploads them to GL, headless tools can
+// mesh them without a window.
+class mesh_sink {
+public:
+  virtual ~mesh_sink() = default;
+  // Return false when too many meshes are in flight already; the chunk stays
+  // dirty and is offered again later. Updates only rebuild the given
+  // sections, meshed at the given level of detail.
+  virtual bool on_chunk_update(const chunk_key &key, const chunk &c,
+                               const section_mask sections,
+                               const unsigned level = 0) = 0;
+  virtual bool on_chunk_insertion(const chunk_key &key, const chunk &c,
+                                  const unsigned level = 0) = 0;
+  virtual void on_chunk_removal(const chunk_key &key) = 0;
+};
+
+} // namespace lexov
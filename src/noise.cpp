@@ -0,0 +1,439 @@
+#include "noise.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+float grad[12][3] = { { 1.0, 1.0, 0.0 }, { -1.0, 1.0, 0.0 }, { 1.0, -1.0, 0.0 },
+                      { -1.0, -1.0, 0.0 }, { 1.0, 0.0, 1.0 },
+                      { -1.0, 0.0, 1.0 }, { 1.0, 0.0, -1.0 },
+                      { -1.0, 0.0, -1.0 }, { 0.0, 1.0, 1.0 },
+                      { 0.0, -1.0, 1.0 }, { 0.0, 1.0, -1.0 },
+                      { 0.0, -1.0, -1.0 } };
+
+int perm[512] = {
+  151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140,
+  36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234,
+  75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237,
+  149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48,
+  27, 166, 77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133, 230, 220, 105,
+  92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161, 1, 216, 80, 73,
+  209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130, 116, 188, 159, 86,
+  164, 100, 109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124, 123, 5, 202, 38,
+  147, 118, 126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16, 58, 17, 182, 189,
+  28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163, 70, 221, 153, 101,
+  155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110, 79, 113, 224, 232,
+  178, 185, 112, 104, 218, 246, 97, 228, 251, 34, 242, 193, 238, 210, 144, 12,
+  191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107, 49, 192, 214, 31,
+  181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45, 127, 4, 150, 254,
+  138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215,
+  61, 156, 180, 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233,
+  7, 225, 140, 36, 103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148,
+  247, 120, 234, 75, 0, 26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57,
+  177, 33, 88, 237, 149, 56, 87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165,
+  71, 134, 139, 48, 27, 166, 77, 146, 158, 231, 83, 111, 229, 122, 60, 211, 133,
+  230, 220, 105, 92, 41, 55, 46, 245, 40, 244, 102, 143, 54, 65, 25, 63, 161, 1,
+  216, 80, 73, 209, 76, 132, 187, 208, 89, 18, 169, 200, 196, 135, 130, 116,
+  188, 159, 86, 164, 100, 109, 198, 173, 186, 3, 64, 52, 217, 226, 250, 124,
+  123, 5, 202, 38, 147, 118, 126, 255, 82, 85, 212, 207, 206, 59, 227, 47, 16,
+  58, 17, 182, 189, 28, 42, 223, 183, 170, 213, 119, 248, 152, 2, 44, 154, 163,
+  70, 221, 153, 101, 155, 167, 43, 172, 9, 129, 22, 39, 253, 19, 98, 108, 110,
+  79, 113, 224, 232, 178, 185, 112, 104, 218, 246, 97, 228, 251, 34, 242, 193,
+  238, 210, 144, 12, 191, 179, 162, 241, 81, 51, 145, 235, 249, 14, 239, 107,
+  49, 192, 214, 31, 181, 199, 106, 157, 184, 84, 204, 176, 115, 121, 50, 45,
+  127, 4, 150, 254, 138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128,
+  195, 78, 66, 215, 61, 156, 180
+};
+
+// perm[i] % 12, so the vector kernels need one lookup per simplex corner
+const std::array<int, 512> perm_mod12 = []() {
+  std::array<int, 512> table;
+  for (std::size_t i = 0; i < table.size(); ++i) {
+    table[i] = perm[i] % 12;
+  }
+  return table;
+}();
+
+float dot(float x, float y, float z, float *g) {
+  return x * g[0] + y * g[1] + z * g[2];
+}
+
+float simplex3(float xin, float yin, float zin) {
+  float F3, G3, t, X0, Y0, Z0, x0, y0, z0, s, x1, y1, z1, x2, y2, z2, x3, y3,
+      z3, t0, t1, t2, t3, n0, n1, n2, n3;
+  int i, j, k, ii, jj, kk, i1, j1, k1, i2, j2, k2, gi0, gi1, gi2, gi3;
+
+  F3 = 1.0 / 3.0;
+  s = (xin + yin + zin) * F3;
+  i = xin + s;
+  j = yin + s;
+  k = zin + s;
+  G3 = 1.0 / 6.0;
+  t = (i + j + k) * G3;
+  X0 = i - t;
+  Y0 = j - t;
+  Z0 = k - t;
+  x0 = xin - X0;
+  y0 = yin - Y0;
+  z0 = zin - Z0;
+
+  if (x0 >= y0) {
+    if (y0 >= z0) {
+      i1 = 1;
+      j1 = 0;
+      k1 = 0;
+      i2 = 1;
+      j2 = 1;
+      k2 = 0;
+    } else if (x0 >= z0) {
+      i1 = 1;
+      j1 = 0;
+      k1 = 0;
+      i2 = 1;
+      j2 = 0;
+      k2 = 1;
+    } else {
+      i1 = 0;
+      j1 = 0;
+      k1 = 1;
+      i2 = 1;
+      j2 = 0;
+      k2 = 1;
+    }
+  } else {
+    if (y0 < z0) {
+      i1 = 0;
+      j1 = 0;
+      k1 = 1;
+      i2 = 0;
+      j2 = 1;
+      k2 = 1;
+    } else if (x0 < z0) {
+      i1 = 0;
+      j1 = 1;
+      k1 = 0;
+      i2 = 0;
+      j2 = 1;
+      k2 = 1;
+    } else {
+      i1 = 0;
+      j1 = 1;
+      k1 = 0;
+      i2 = 1;
+      j2 = 1;
+      k2 = 0;
+    }
+  }
+
+  x1 = x0 - i1 + G3;
+  y1 = y0 - j1 + G3;
+  z1 = z0 - k1 + G3;
+  x2 = x0 - i2 + 2.0 * G3;
+  y2 = y0 - j2 + 2.0 * G3;
+  z2 = z0 - k2 + 2.0 * G3;
+  x3 = x0 - 1.0 + 3.0 * G3;
+  y3 = y0 - 1.0 + 3.0 * G3;
+  z3 = z0 - 1.0 + 3.0 * G3;
+
+  ii = i & 255;
+  jj = j & 255;
+  kk = k & 255;
+
+  gi0 = perm[ii + perm[jj + perm[kk]]] % 12;
+  gi1 = perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12;
+  gi2 = perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12;
+  gi3 = perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12;
+
+  t0 = 0.6 - x0 * x0 - y0 * y0 - z0 * z0;
+  if (t0 < 0) {
+    n0 = 0.0;
+  } else {
+    t0 *= t0;
+    n0 = t0 * t0 * dot(x0, y0, z0, grad[gi0]);
+  }
+
+  t1 = 0.6 - x1 * x1 - y1 * y1 - z1 * z1;
+  if (t1 < 0) {
+    n1 = 0.0;
+  } else {
+    t1 *= t1;
+    n1 = t1 * t1 * dot(x1, y1, z1, grad[gi1]);
+  }
+
+  t2 = 0.6 - x2 * x2 - y2 * y2 - z2 * z2;
+  if (t2 < 0) {
+    n2 = 0.0;
+  } else {
+    t2 *= t2;
+    n2 = t2 * t2 * dot(x2, y2, z2, grad[gi2]);
+  }
+
+  t3 = 0.6 - x3 * x3 - y3 * y3 - z3 * z3;
+  if (t3 < 0) {
+    n3 = 0.0;
+  } else {
+    t3 *= t3;
+    n3 = t3 * t3 * dot(x3, y3, z3, grad[gi3]);
+  }
+
+  return 16.0 * (n0 + n1 + n2 + n3) + 1.0;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// Vector kernel shared by every instruction set. V wraps the intrinsics of one
+// instruction set behind the handful of operations the kernel needs.
+template <class V>
+typename V::vf grad_dot(const typename V::vi h, const typename V::vf x,
+                        const typename V::vf y, const typename V::vf z) {
+  // Same table as grad: gradients 0-7 use x, 8-11 use y as their first
+  // component; 0-3 use y, 4-11 use z as their second. Bits 0 and 1 of the
+  // index flip the sign of the first and second component.
+  const auto u = V::select(V::lt(h, V::set1i(8)), x, y);
+  const auto v = V::select(V::lt(h, V::set1i(4)), y, z);
+  const auto sign = V::set1(-0.0f);
+  const auto flip_u = V::eq(V::andi(h, V::set1i(1)), V::set1i(1));
+  const auto flip_v = V::eq(V::andi(h, V::set1i(2)), V::set1i(2));
+  return V::add(V::bit_xor(u, V::bit_and(flip_u, sign)),
+                V::bit_xor(v, V::bit_and(flip_v, sign)));
+}
+
+template <class V>
+typename V::vf corner(const typename V::vi gi, const typename V::vf x,
+                      const typename V::vf y, const typename V::vf z) {
+  auto t = V::sub(V::sub(V::sub(V::set1(0.6f), V::mul(x, x)), V::mul(y, y)),
+                  V::mul(z, z));
+  t = V::max(t, V::set1(0.0f));
+  t = V::mul(t, t);
+  return V::mul(V::mul(t, t), grad_dot<V>(gi, x, y, z));
+}
+
+template <class V>
+typename V::vf simplex_vector(const typename V::vf xin,
+                              const typename V::vf yin,
+                              const typename V::vf zin) {
+  const auto one = V::set1(1.0f);
+  const auto F3 = V::set1(static_cast<float>(1.0 / 3.0));
+  const auto G3 = V::set1(static_cast<float>(1.0 / 6.0));
+  const auto s = V::mul(V::add(V::add(xin, yin), zin), F3);
+  const auto i = V::cvtt(V::add(xin, s));
+  const auto j = V::cvtt(V::add(yin, s));
+  const auto k = V::cvtt(V::add(zin, s));
+  const auto t = V::mul(V::cvt(V::addi(V::addi(i, j), k)), G3);
+  const auto x0 = V::sub(xin, V::sub(V::cvt(i), t));
+  const auto y0 = V::sub(yin, V::sub(V::cvt(j), t));
+  const auto z0 = V::sub(zin, V::sub(V::cvt(k), t));
+
+  // rank the offsets to find the simplex, as the branches of simplex3 do
+  const auto xy = V::ge(x0, y0);
+  const auto yz = V::ge(y0, z0);
+  const auto xz = V::ge(x0, z0);
+  const auto i1 = V::bit_and(V::bit_and(xy, xz), one);
+  const auto j1 = V::bit_and(V::bit_andnot(xy, yz), one);
+  const auto k1 = V::bit_andnot(xz, V::bit_andnot(yz, one));
+  const auto i2 = V::bit_and(V::bit_or(xy, xz), one);
+  const auto j2 = V::bit_andnot(V::bit_andnot(yz, xy), one);
+  const auto k2 = V::bit_andnot(V::bit_and(xz, yz), one);
+
+  const auto G3_2 = V::set1(static_cast<float>(2.0 / 6.0));
+  const auto G3_3 = V::set1(static_cast<float>(3.0 / 6.0));
+  const auto x1 = V::add(V::sub(x0, i1), G3);
+  const auto y1 = V::add(V::sub(y0, j1), G3);
+  const auto z1 = V::add(V::sub(z0, k1), G3);
+  const auto x2 = V::add(V::sub(x0, i2), G3_2);
+  const auto y2 = V::add(V::sub(y0, j2), G3_2);
+  const auto z2 = V::add(V::sub(z0, k2), G3_2);
+  const auto x3 = V::add(V::sub(x0, one), G3_3);
+  const auto y3 = V::add(V::sub(y0, one), G3_3);
+  const auto z3 = V::add(V::sub(z0, one), G3_3);
+
+  const auto mask = V::set1i(255);
+  const auto ii = V::andi(i, mask);
+  const auto jj = V::andi(j, mask);
+  const auto kk = V::andi(k, mask);
+  const auto hash = [&](const typename V::vi a, const typename V::vi b,
+                        const typename V::vi c) {
+    const auto pk = V::gather(perm, V::addi(kk, c));
+    const auto pj = V::gather(perm, V::addi(V::addi(jj, b), pk));
+    return V::gather(perm_mod12.data(), V::addi(V::addi(ii, a), pj));
+  };
+  const auto zero_i = V::set1i(0);
+  const auto one_i = V::set1i(1);
+  const auto gi0 = hash(zero_i, zero_i, zero_i);
+  const auto gi1 = hash(V::cvtt(i1), V::cvtt(j1), V::cvtt(k1));
+  const auto gi2 = hash(V::cvtt(i2), V::cvtt(j2), V::cvtt(k2));
+  const auto gi3 = hash(one_i, one_i, one_i);
+
+  const auto n = V::add(V::add(corner<V>(gi0, x0, y0, z0),
+                               corner<V>(gi1, x1, y1, z1)),
+                        V::add(corner<V>(gi2, x2, y2, z2),
+                               corner<V>(gi3, x3, y3, z3)));
+  return V::add(V::mul(V::set1(16.0f), n), one);
+}
+#endif
+
+#if defined(__AVX2__)
+struct vector_ops {
+  using vf = __m256;
+  using vi = __m256i;
+  static constexpr std::size_t width = 8;
+  static const char *name() { return "avx2"; }
+  static vf load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, const vf a) { _mm256_storeu_ps(p, a); }
+  static vf set1(const float a) { return _mm256_set1_ps(a); }
+  static vi set1i(const int a) { return _mm256_set1_epi32(a); }
+  static vf add(const vf a, const vf b) { return _mm256_add_ps(a, b); }
+  static vf sub(const vf a, const vf b) { return _mm256_sub_ps(a, b); }
+  static vf mul(const vf a, const vf b) { return _mm256_mul_ps(a, b); }
+  static vf max(const vf a, const vf b) { return _mm256_max_ps(a, b); }
+  static vf ge(const vf a, const vf b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  static vf bit_and(const vf a, const vf b) { return _mm256_and_ps(a, b); }
+  static vf bit_or(const vf a, const vf b) { return _mm256_or_ps(a, b); }
+  static vf bit_xor(const vf a, const vf b) { return _mm256_xor_ps(a, b); }
+  // ~a & b
+  static vf bit_andnot(const vf a, const vf b) { return _mm256_andnot_ps(a, b); }
+  static vf select(const vf mask, const vf a, const vf b) {
+    return _mm256_blendv_ps(b, a, mask);
+  }
+  static vi cvtt(const vf a) { return _mm256_cvttps_epi32(a); }
+  static vf cvt(const vi a) { return _mm256_cvtepi32_ps(a); }
+  static vi addi(const vi a, const vi b) { return _mm256_add_epi32(a, b); }
+  static vi andi(const vi a, const vi b) { return _mm256_and_si256(a, b); }
+  static vf lt(const vi a, const vi b) {
+    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a));
+  }
+  static vf eq(const vi a, const vi b) {
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b));
+  }
+  static vi gather(const int *table, const vi index) {
+    return _mm256_i32gather_epi32(table, index, 4);
+  }
+};
+#elif defined(__SSE2__)
+struct vector_ops {
+  using vf = __m128;
+  using vi = __m128i;
+  static constexpr std::size_t width = 4;
+  static const char *name() { return "sse2"; }
+  static vf load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, const vf a) { _mm_storeu_ps(p, a); }
+  static vf set1(const float a) { return _mm_set1_ps(a); }
+  static vi set1i(const int a) { return _mm_set1_epi32(a); }
+  static vf add(const vf a, const vf b) { return _mm_add_ps(a, b); }
+  static vf sub(const vf a, const vf b) { return _mm_sub_ps(a, b); }
+  static vf mul(const vf a, const vf b) { return _mm_mul_ps(a, b); }
+  static vf max(const vf a, const vf b) { return _mm_max_ps(a, b); }
+  static vf ge(const vf a, const vf b) { return _mm_cmpge_ps(a, b); }
+  static vf bit_and(const vf a, const vf b) { return _mm_and_ps(a, b); }
+  static vf bit_or(const vf a, const vf b) { return _mm_or_ps(a, b); }
+  static vf bit_xor(const vf a, const vf b) { return _mm_xor_ps(a, b); }
+  // ~a & b
+  static vf bit_andnot(const vf a, const vf b) { return _mm_andnot_ps(a, b); }
+  static vf select(const vf mask, const vf a, const vf b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+  static vi cvtt(const vf a) { return _mm_cvttps_epi32(a); }
+  static vf cvt(const vi a) { return _mm_cvtepi32_ps(a); }
+  static vi addi(const vi a, const vi b) { return _mm_add_epi32(a, b); }
+  static vi andi(const vi a, const vi b) { return _mm_and_si128(a, b); }
+  static vf lt(const vi a, const vi b) {
+    return _mm_castsi128_ps(_mm_cmplt_epi32(a, b));
+  }
+  static vf eq(const vi a, const vi b) {
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b));
+  }
+  // SSE2 has no gather, look the lanes up one by one
+  static vi gather(const int *table, const vi index) {
+    alignas(16) int lanes[4];
+    _mm_store_si128(reinterpret_cast<vi *>(lanes), index);
+    for (auto &lane : lanes) {
+      lane = table[lane];
+    }
+    return _mm_load_si128(reinterpret_cast<const vi *>(lanes));
+  }
+};
+#endif
+}
+
+namespace lexov {
+
+float noise::simplex(const float x, const float y, const float z) {
+  return simplex3(x, y, z);
+}
+
+float noise::simplex_octaves(const int octaves, const float x, const float y,
+                             const float z) {
+  float value = 0.0;
+  float scale = 1.0;
+  for (int i = 0; i < octaves; ++i) {
+    // scaling by a power of two is exact, so this matches pow(2, i)
+    value += simplex3(x * scale, y * scale, z * scale);
+    scale *= 2;
+  }
+  return value;
+}
+
+void noise::simplex_batch(const float *x, const float *y, const float *z,
+                          float *out, const std::size_t n) {
+#if defined(__AVX2__) || defined(__SSE2__)
+  using V = vector_ops;
+  std::size_t i = 0;
+  for (; i + V::width <= n; i += V::width) {
+    V::store(out + i,
+             simplex_vector<V>(V::load(x + i), V::load(y + i), V::load(z + i)));
+  }
+  if (i < n) {
+    // pad the tail so every point goes through the same kernel
+    float tail[4][V::width] = {};
+    const auto rest = n - i;
+    std::copy(x + i, x + n, tail[0]);
+    std::copy(y + i, y + n, tail[1]);
+    std::copy(z + i, z + n, tail[2]);
+    V::store(tail[3], simplex_vector<V>(V::load(tail[0]), V::load(tail[1]),
+                                        V::load(tail[2])));
+    std::copy(tail[3], tail[3] + rest, out + i);
+  }
+#else
+  for (std::size_t i = 0; i < n; ++i) {
+    out[i] = simplex3(x[i], y[i], z[i]);
+  }
+#endif
+}
+
+void noise::simplex_octaves_batch(const int octaves, const float *x,
+                                  const float *y, const float *z, float *out,
+                                  const std::size_t n) {
+  constexpr std::size_t block = 256;
+  float sx[block], sy[block], sz[block], octave[block];
+  for (std::size_t begin = 0; begin < n; begin += block) {
+    const auto count = std::min(block, n - begin);
+    std::fill(out + begin, out + begin + count, 0.0f);
+    float scale = 1.0;
+    for (int i = 0; i < octaves; ++i) {
+      for (std::size_t p = 0; p < count; ++p) {
+        sx[p] = x[begin + p] * scale;
+        sy[p] = y[begin + p] * scale;
+        sz[p] = z[begin + p] * scale;
+      }
+      simplex_batch(sx, sy, sz, octave, count);
+      for (std::size_t p = 0; p < count; ++p) {
+        out[begin + p] += octave[p];
+      }
+      scale *= 2;
+    }
+  }
+}
+
+const char *noise::instruction_set() {
+#if defined(__AVX2__) || defined(__SSE2__)
+  return vector_ops::name();
+#else
+  return "scalar";
+#endif
+}
+
+} // namespace lexov
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace lexov {
+
+// 3D simplex noise. Values are offset by one, so they lie roughly in [0, 2].
+namespace noise {
+  float simplex(const float x, const float y, const float z);
+  // Sums octaves at doubling frequencies
+  float simplex_octaves(const int octaves, const float x, const float y,
+                        const float z);
+
+  // Evaluates n points at once using the widest vector instruction set the
+  // translation unit was compiled for. Results match the scalar functions to
+  // within batch_tolerance.
+  void simplex_batch(const float *x, const float *y, const float *z,
+                     float *out, const std::size_t n);
+  void simplex_octaves_batch(const int octaves, const float *x, const float *y,
+                             const float *z, float *out, const std::size_t n);
+
+  // Absolute tolerance between batch and scalar results of a single octave
+  constexpr float batch_tolerance = 1e-5f;
+
+  // "avx2", "sse2" or "scalar"
+  const char *instruction_set();
+
+  // Counter based random bits for the lattice point (x, y, z) of the world
+  // with the given seed. A pure function of its arguments, so voxels can be
+  // drawn in any order, on any thread and in vector lanes, and a point
+  // draws the same bits on every run.
+  inline std::uint64_t hash(const std::uint64_t seed, const std::int32_t x,
+                            const std::int32_t y, const std::int32_t z) {
+    // two rounds of the splitmix64 finalizer over the packed coordinates
+    const auto mix = [](std::uint64_t h) {
+      h += 0x9e3779b97f4a7c15;
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+      return h ^ (h >> 31);
+    };
+    const auto h = mix(seed ^ static_cast<std::uint32_t>(x));
+    return mix(h ^ (std::uint64_t{ static_cast<std::uint32_t>(y) } << 32 |
+                    static_cast<std::uint32_t>(z)));
+  }
+
+  // Uniform in [0, 1) from 32 random bits
+  inline float to_unit(const std::uint32_t bits) {
+    return (bits >> 8) * (1.0f / (1u << 24));
+  }
+}
+
+} // namespace lexov
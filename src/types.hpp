@@ -1,6 +1,7 @@
 #pragma once
 #include "utility.hpp"
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <tuple>
 
@@ -11,6 +12,16 @@ enum class block_type : std::uint_least8_t {
   air = 0, grass, dirt, water, stone, count
 };
 
+// Block properties shared by every chunk storage backend
+constexpr bool is_solid_block(const block_type t) {
+  return t != block_type::air;
+}
+
+constexpr bool is_transparent_block(const block_type) {
+  // return t == block_type::water;
+  return false;
+}
+
 enum class face : std::uint_least8_t {
   front, back, left, right, top, bottom
 };
@@ -23,6 +34,16 @@ constexpr const local_size_t chunk_width = 16;
 constexpr const local_size_t chunk_height = 128;
 constexpr const local_size_t chunk_depth = 16;
 
+// Chunks are meshed and marked dirty in vertical sections of this many layers
+constexpr const local_size_t section_height = 16;
+constexpr const std::size_t chunk_sections = chunk_height / section_height;
+// Bit s stands for section s of a chunk
+using section_mask = std::uint32_t;
+// Summary of a section: no solid voxel, only opaque voxels, or anything else
+enum class section_state : std::uint_least8_t {
+  empty, full, mixed
+};
+
 constexpr const local_size_t half_chunk_width = chunk_width / 2;
 constexpr const local_size_t half_chunk_height = chunk_height / 2;
 constexpr const local_size_t half_chunk_depth = chunk_depth / 2;
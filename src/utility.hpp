@@ -9,6 +9,12 @@ inline void hash_combine(std::size_t& seed, const T& v)
     seed ^= hasher(v) + 0x9e3779b9 + (seed<<6) + (seed>>2);
 }
 
+// Integer division rounding towards negative infinity, e.g. for the chunk
+// holding a negative world coordinate
+constexpr long long floor_div(const long long a, const long long b) {
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
 constexpr std::size_t isqrt_impl
     (std::size_t sq, std::size_t dlt, std::size_t value){
     return sq <= value ?
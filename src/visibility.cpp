@@ -0,0 +1,84 @@
+#include "visibility.hpp"
+#include <bitset>
+
+namespace lexov {
+
+chunk_connectivity visibility::compute_connectivity(const chunk_snapshot &s) {
+  if (s.is_empty()) {
+    return chunk_connectivity::all();
+  }
+  constexpr int W = chunk::width, H = chunk::height, D = chunk::depth;
+  static_assert(chunk::volume <= 0x10000, "voxel indices are 16 bit");
+  // Voxel index x + W * (z + D * y), opaque voxels start out visited
+  std::bitset<chunk::volume> visited;
+  for (int z = 0; z < D; ++z) {
+    for (int x = 0; x < W; ++x) {
+      const auto &opaque = s.get_column(x, z).opaque;
+      opaque.for_each_set_bit(
+          [&](const std::size_t y) { visited.set(x + W * (z + D * y)); });
+    }
+  }
+  if (visited.all()) {
+    return chunk_connectivity::none();
+  }
+
+  // One flood fill per air region touching the border, every pair of faces
+  // the region touches sees each other
+  static thread_local std::vector<std::uint16_t> stack;
+  chunk_connectivity connectivity;
+  const auto fill = [&](const int x0, const int y0, const int z0) {
+    const std::size_t start = x0 + W * (z0 + D * y0);
+    if (visited.test(start)) {
+      return;
+    }
+    visited.set(start);
+    stack.assign(1, static_cast<std::uint16_t>(start));
+    unsigned faces = 0;
+    while (!stack.empty()) {
+      const std::size_t i = stack.back();
+      stack.pop_back();
+      const int x = i % W, z = (i / W) % D, y = i / (W * D);
+      const auto visit = [&](const bool border, const face f,
+                             const std::size_t next) {
+        if (border) {
+          faces |= 1u << static_cast<unsigned>(f);
+        } else if (!visited.test(next)) {
+          visited.set(next);
+          stack.push_back(static_cast<std::uint16_t>(next));
+        }
+      };
+      visit(z == 0, face::front, i - W);
+      visit(z == D - 1, face::back, i + W);
+      visit(x == 0, face::left, i - 1);
+      visit(x == W - 1, face::right, i + 1);
+      visit(y == H - 1, face::top, i + W * D);
+      visit(y == 0, face::bottom, i - W * D);
+    }
+    for (unsigned a = 0; a < 6; ++a) {
+      for (unsigned b = a + 1; b < 6; ++b) {
+        if ((faces >> a & 1) && (faces >> b & 1)) {
+          connectivity.connect(static_cast<face>(a), static_cast<face>(b));
+        }
+      }
+    }
+  };
+  for (int y = 0; y < H; ++y) {
+    for (int i = 0; i < W; ++i) {
+      fill(i, y, 0);
+      fill(i, y, D - 1);
+    }
+    for (int i = 0; i < D; ++i) {
+      fill(0, y, i);
+      fill(W - 1, y, i);
+    }
+  }
+  for (int z = 0; z < D; ++z) {
+    for (int x = 0; x < W; ++x) {
+      fill(x, 0, z);
+      fill(x, H - 1, z);
+    }
+  }
+  return connectivity;
+}
+
+} // namespace lexov
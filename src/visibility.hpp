@@ -0,0 +1,161 @@
+#pragma once
+#include "chunk.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <tuple>
+#include <vector>
+
+namespace lexov {
+
+// Which faces of a chunk can see each other through non-opaque voxels, used
+// to cull chunks hidden behind rock (cave culling)
+class chunk_connectivity {
+public:
+  // Every face sees every other face, e.g. an all air chunk
+  static chunk_connectivity all() {
+    chunk_connectivity c;
+    c.bits = (std::uint64_t{ 1 } << 36) - 1;
+    return c;
+  }
+  // No face sees another, e.g. a solid chunk
+  static chunk_connectivity none() { return chunk_connectivity{}; }
+
+  bool connects(const face a, const face b) const {
+    return (bits >> bit(a, b)) & 1;
+  }
+  void connect(const face a, const face b) {
+    bits |= std::uint64_t{ 1 } << bit(a, b);
+    bits |= std::uint64_t{ 1 } << bit(b, a);
+  }
+
+  bool operator==(const chunk_connectivity &other) const {
+    return bits == other.bits;
+  }
+  bool operator!=(const chunk_connectivity &other) const {
+    return bits != other.bits;
+  }
+
+private:
+  static unsigned bit(const face a, const face b) {
+    return static_cast<unsigned>(a) * 6 + static_cast<unsigned>(b);
+  }
+  std::uint64_t bits{ 0 };
+};
+
+namespace visibility {
+  // Flood fills the non-opaque voxels of the snapshotted chunk, its
+  // neighbors are ignored
+  chunk_connectivity compute_connectivity(const chunk_snapshot &s);
+
+  // Face of the neighbor that touches face f
+  inline face opposite(const face f) {
+    static const face opposites[] = { face::back,  face::front, face::right,
+                                      face::left,  face::bottom, face::top };
+    return opposites[static_cast<std::size_t>(f)];
+  }
+
+  // Key of the chunk across face f
+  inline chunk_key neighbor_key(const chunk_key &key, const face f) {
+    static const int offsets[6][3] = { { 0, 0, -1 }, { 0, 0, 1 },
+                                       { -1, 0, 0 }, { 1, 0, 0 },
+                                       { 0, 1, 0 },  { 0, -1, 0 } };
+    const auto &o = offsets[static_cast<std::size_t>(f)];
+    return chunk_key{ std::get<0>(key) + o[0], std::get<1>(key) + o[1],
+                      std::get<2>(key) + o[2] };
+  }
+
+  // Breadth first search from the camera chunk through the chunks in the box
+  // [lo, hi]. A chunk entered through one face is left through the faces that
+  // face connects to, and the search never steps back towards the camera.
+  // connectivity(key) returns a pointer to the chunk_connectivity of key, or
+  // nullptr for chunks without one yet, which count as air. Replaces
+  // reachable with the chunks found, the camera chunk first.
+  template <class Lookup>
+  void find_reachable_chunks(const chunk_key &camera, const chunk_key &lo,
+                             const chunk_key &hi, const Lookup &connectivity,
+                             std::vector<chunk_key> &reachable);
+}
+
+template <class Lookup>
+void visibility::find_reachable_chunks(const chunk_key &camera,
+                                       const chunk_key &lo,
+                                       const chunk_key &hi,
+                                       const Lookup &connectivity,
+                                       std::vector<chunk_key> &reachable) {
+  reachable.clear();
+  const auto inside = [&lo, &hi](const chunk_key &k) {
+    return std::get<0>(k) >= std::get<0>(lo) &&
+           std::get<0>(k) <= std::get<0>(hi) &&
+           std::get<1>(k) >= std::get<1>(lo) &&
+           std::get<1>(k) <= std::get<1>(hi) &&
+           std::get<2>(k) >= std::get<2>(lo) &&
+           std::get<2>(k) <= std::get<2>(hi);
+  };
+  // camera may lie outside the box, e.g. above the loaded chunks; the search
+  // then starts from it but only reports chunks inside the box
+  const auto extent = [](const world_size_t a, const world_size_t b,
+                         const world_size_t c) {
+    return std::max(b, c) - std::min(a, c) + 1;
+  };
+  const auto min_x = std::min(std::get<0>(lo), std::get<0>(camera));
+  const auto min_y = std::min(std::get<1>(lo), std::get<1>(camera));
+  const auto min_z = std::min(std::get<2>(lo), std::get<2>(camera));
+  const auto size_x =
+      extent(std::get<0>(lo), std::get<0>(hi), std::get<0>(camera));
+  const auto size_y =
+      extent(std::get<1>(lo), std::get<1>(hi), std::get<1>(camera));
+  const auto size_z =
+      extent(std::get<2>(lo), std::get<2>(hi), std::get<2>(camera));
+  std::vector<bool> visited(size_x * size_y * size_z, false);
+  const auto index = [&](const chunk_key &k) {
+    return (std::get<0>(k) - min_x) +
+           size_x * ((std::get<1>(k) - min_y) +
+                     size_y * (std::get<2>(k) - min_z));
+  };
+  const auto in_search = [&](const chunk_key &k) {
+    return std::get<0>(k) >= min_x && std::get<0>(k) < min_x + size_x &&
+           std::get<1>(k) >= min_y && std::get<1>(k) < min_y + size_y &&
+           std::get<2>(k) >= min_z && std::get<2>(k) < min_z + size_z;
+  };
+
+  struct step {
+    chunk_key key;
+    // Face the chunk was entered through, unused for the camera chunk
+    face entry;
+    // Bit f is set once the path went out through face f
+    std::uint8_t directions;
+  };
+  std::deque<step> queue;
+  queue.push_back(step{ camera, face::front, 0 });
+  visited[index(camera)] = true;
+  while (!queue.empty()) {
+    const auto current = queue.front();
+    queue.pop_front();
+    if (inside(current.key)) {
+      reachable.push_back(current.key);
+    }
+    const auto c = connectivity(current.key);
+    for (int i = 0; i < 6; ++i) {
+      const auto out = static_cast<face>(i);
+      const auto back_bit = 1u << static_cast<unsigned>(opposite(out));
+      if (current.directions & back_bit) {
+        continue;
+      }
+      if (current.key != camera && c && !c->connects(current.entry, out)) {
+        continue;
+      }
+      const auto next = neighbor_key(current.key, out);
+      if (!in_search(next) || visited[index(next)]) {
+        continue;
+      }
+      visited[index(next)] = true;
+      queue.push_back(step{ next, opposite(out),
+                            static_cast<std::uint8_t>(current.directions |
+                                                      (1u << i)) });
+    }
+  }
+}
+
+} // namespace lexov